@@ -1,7 +1,10 @@
 APP = triangle
 
+# debug, release, profile, instrument or pgo, e.g. make -f Makefile.linux.mak CONFIG=release
+CONFIG = debug
+
 APP_DIR = app
-OBJ_DIR = obj
+OBJ_DIR = obj/$(CONFIG)
 SHADER_DIR = app/shader
 
 SRC_DIR = src
@@ -15,38 +18,173 @@ VERT_SHADER = $(shell find $(SHADER_SRC_DIR) -name '*.vert')
 FRAG_SPIRV = $(patsubst $(SHADER_SRC_DIR)/%.frag, $(SHADER_DIR)/%.frag.spv, $(FRAG_SHADER))
 VERT_SPIRV = $(patsubst $(SHADER_SRC_DIR)/%.vert, $(SHADER_DIR)/%.vert.spv, $(VERT_SHADER))
 SPIRV = $(FRAG_SPIRV) $(VERT_SPIRV)
+# Straight from glslc, before optimization.
+SPIRV_UNOPTIMIZED = $(patsubst $(SHADER_DIR)/%, $(OBJ_DIR)/shader/%, $(SPIRV))
 
 CC = clang
-CFLAGS = -g -Wall
 INC_FLAGS = -I$(SRC_DIR) -I/usr/include
-LINK_FLAGS = -lwayland-client -lvulkan
+LINK_FLAGS = -lwayland-client -lxkbcommon -lvulkan -lpthread -lm
 DEFINES = -DPLATFORM_WAYLAND
 
+# debug: no optimization, validation layer, every log level and debug assertions.
+# release: -O3 with ThinLTO, no validation layer or debug messenger, debug and trace logs
+#   compiled out.
+# profile: release with symbols and frame pointers, for perf and the --trace timeline.
+# instrument, pgo: release built to record a profile and built again optimized with it, see pgo.
+PGO_DIR = pgo
+PGO_PROFDATA = $(PGO_DIR)/triangle.profdata
+ifeq ($(CONFIG),release)
+CFLAGS = -O3 -flto=thin -Wall
+LINK_FLAGS += -fuse-ld=lld
+DEFINES += -DREXRELEASE=1
+else ifeq ($(CONFIG),profile)
+CFLAGS = -O3 -flto=thin -g -fno-omit-frame-pointer -Wall
+LINK_FLAGS += -fuse-ld=lld
+DEFINES += -DREXRELEASE=1
+else ifeq ($(CONFIG),instrument)
+CFLAGS = -O3 -flto=thin -fprofile-instr-generate -Wall
+LINK_FLAGS += -fuse-ld=lld
+DEFINES += -DREXRELEASE=1
+else ifeq ($(CONFIG),pgo)
+CFLAGS = -O3 -flto=thin -fprofile-instr-use=$(PGO_PROFDATA) -Wall
+LINK_FLAGS += -fuse-ld=lld
+DEFINES += -DREXRELEASE=1
+else ifeq ($(CONFIG),debug)
+CFLAGS = -g -Wall
+DEFINES += -D_DEBUG
+else
+$(error unknown CONFIG $(CONFIG), use debug, release, profile, instrument or pgo)
+endif
+
+# Every configuration links to the same app/triangle, a change of configuration relinks it.
+CONFIG_STAMP = $(OBJ_DIR)/.config
+
 SHADERC = glslc
+SPIRV_OPT = spirv-opt
+SPIRV_VAL = spirv-val
+SPIRV_DIS = spirv-dis
+# The lowest version the renderer runs on, devices without 1.3 are still supported.
+SHADER_TARGET_ENV = vulkan1.0
+
+# Shaders are optimized in every configuration, debug and profile keep the names of variables
+# and functions for capture tools.
+SPIRV_OPT_FLAGS = -O --target-env=$(SHADER_TARGET_ENV)
+ifeq ($(filter $(CONFIG),debug profile),)
+SPIRV_OPT_FLAGS += --strip-debug
+endif
+
+# Size and instruction count of a shader before and after optimization, the disassembly has
+# one instruction per line.
+spirv_report = echo "$(notdir $(2)): $$(wc -c < $(1)) -> $$(wc -c < $(2)) bytes, $$($(SPIRV_DIS) --no-header $(1) | wc -l) -> $$($(SPIRV_DIS) --no-header $(2) | wc -l) instructions"
 
 all: build
 
 build: $(APP_DIR)/$(APP) $(SPIRV)
 
 # Build App
-$(APP_DIR)/$(APP): $(OBJ)
+$(APP_DIR)/$(APP): $(OBJ) $(CONFIG_STAMP)
 	@mkdir -p $(APP_DIR)
 	clang $(CFLAGS) $(LINK_FLAGS) $(OBJ) -o $@
 
+# Touched when the last build was of another configuration.
+$(CONFIG_STAMP): FORCE
+	@mkdir -p $(dir $@)
+	@if [ "$$(cat $(APP_DIR)/.config 2>/dev/null)" != "$(CONFIG)" ]; then \
+		mkdir -p $(APP_DIR) && echo $(CONFIG) > $(APP_DIR)/.config && touch $@; \
+	fi
+
 # Build objects
 $(OBJ_DIR)/%.o: $(SRC_DIR)/%.c
 	@mkdir -p $(dir $@)
 	$(CC) $(CFLAGS) $(DEFINES) $(INC_FLAGS) -c $< -o $@
 
+# Objects are optimized again whenever the profile changes.
+ifeq ($(CONFIG),pgo)
+$(OBJ): $(PGO_PROFDATA)
+endif
+
+$(PGO_PROFDATA):
+	$(error $(PGO_PROFDATA) is missing, record it with the pgo target)
+
 # Build shader spir-v
-$(SHADER_DIR)/%.spv: $(SHADER_SRC_DIR)/%
+$(OBJ_DIR)/shader/%.spv: $(SHADER_SRC_DIR)/%
+	@mkdir -p $(dir $@)
+	$(SHADERC) --target-env=$(SHADER_TARGET_ENV) $< -o $@
+
+# Optimized and validated before it replaces the loaded module. Optimized again when the
+# configuration changes, only some strip debug info.
+$(SHADER_DIR)/%.spv: $(OBJ_DIR)/shader/%.spv $(CONFIG_STAMP)
 	@mkdir -p $(dir $@)
-	glslc $< -o $@
+	$(SPIRV_OPT) $(SPIRV_OPT_FLAGS) $< -o $@.tmp
+	$(SPIRV_VAL) --target-env $(SHADER_TARGET_ENV) $@.tmp
+	@mv $@.tmp $@
+	@$(call spirv_report,$<,$@)
+
+# Kept for shader-report.
+.SECONDARY: $(SPIRV_UNOPTIMIZED)
+
+shader-report: $(SPIRV)
+	@$(foreach spv,$(SPIRV),$(call spirv_report,$(patsubst $(SHADER_DIR)/%,$(OBJ_DIR)/shader/%,$(spv)),$(spv));)
 
 run: build
 	@cd $(APP_DIR) && ./$(APP)
 
+# Run with shaders recompiled and reloaded when a file in shader/ changes
+watch: build
+	@cd $(APP_DIR) && ./$(APP) --watch-shaders
+
+# Fixed length headless benchmark, results in app/bench.json. BASELINE=<file> fails the run
+# if it regressed compared to an earlier results file.
+BENCH_FRAMES = 1000
+bench: build
+	@cd $(APP_DIR) && ./$(APP) --headless --bench $(BENCH_FRAMES) $(if $(BASELINE),--bench-baseline $(abspath $(BASELINE)))
+
+# Renders each scene headless and compares it against its image in golden/, within a
+# tolerance. Runs on lavapipe, golden-update renders the images again after an intended change.
+# Every scene is checked, a scene without a golden image is listed but only mismatches fail.
+GOLDEN_DIR = golden
+GOLDEN_FLAGS =
+golden_scene = ./$(APP) $(GOLDEN_FLAGS) --golden ../$(GOLDEN_DIR)/$(1).ppm $(2); \
+	case $$? in 0) ;; 2) missing="$$missing $(1)";; *) failed="$$failed $(1)";; esac;
+golden: build
+	@mkdir -p $(GOLDEN_DIR)
+	@cd $(APP_DIR) && missing= && failed= && \
+	$(call golden_scene,triangle,) \
+	$(call golden_scene,overdraw,--overdraw 16) \
+	$(call golden_scene,msaa,--msaa 4 --overdraw 4) \
+	$(call golden_scene,static_state,--static-pipeline-state) \
+	$(call golden_scene,shader_variants,--shader-variants --overdraw 8) \
+	if [ -n "$$missing" ]; then echo "No golden image for:$$missing, check the .actual.ppm files and run golden-update"; fi; \
+	if [ -n "$$failed" ]; then echo "Golden image mismatch:$$failed"; exit 1; fi
+
+golden-update:
+	@$(MAKE) -f $(firstword $(MAKEFILE_LIST)) golden GOLDEN_FLAGS=--update-golden
+
+# Profile guided build. An instrumented build renders a few headless benchmarks that cover
+# the common paths, then the app is built again with the merged profile, linked to app/triangle.
+PGO_TRAINING_FRAMES = 2000
+PROFDATA = llvm-profdata
+pgo-train:
+	@$(MAKE) -f $(firstword $(MAKEFILE_LIST)) build CONFIG=instrument
+	@rm -rf $(PGO_DIR)/raw && mkdir -p $(PGO_DIR)/raw
+	@cd $(APP_DIR) && export LLVM_PROFILE_FILE=$(abspath $(PGO_DIR))/raw/triangle-%p.profraw && \
+	./$(APP) --headless --bench $(PGO_TRAINING_FRAMES) --bench-results $(abspath $(PGO_DIR))/triangle.json && \
+	./$(APP) --headless --bench $(PGO_TRAINING_FRAMES) --bench-results $(abspath $(PGO_DIR))/overdraw.json --overdraw 16 && \
+	./$(APP) --headless --bench $(PGO_TRAINING_FRAMES) --bench-results $(abspath $(PGO_DIR))/msaa.json --msaa 4 --overdraw 4
+	$(PROFDATA) merge -o $(PGO_PROFDATA) $(PGO_DIR)/raw/*.profraw
+
+pgo: pgo-train
+	@$(MAKE) -f $(firstword $(MAKEFILE_LIST)) build CONFIG=pgo
+
 clean:
-	rm -rf $(APP_DIR) $(OBJ_DIR)
+	rm -rf $(APP_DIR) obj $(PGO_DIR)
+
+release:
+	@$(MAKE) -f $(firstword $(MAKEFILE_LIST)) build CONFIG=release
+
+profile:
+	@$(MAKE) -f $(firstword $(MAKEFILE_LIST)) build CONFIG=profile
+
+FORCE:
 
-.PHONY: all build run clean
+.PHONY: all build shader-report run watch bench golden golden-update release profile pgo-train pgo clean FORCE
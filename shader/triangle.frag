@@ -1,9 +1,20 @@
 #version 450
 
+// Specialization constants, ids match ShaderConstant in triangle.c
+layout(constant_id = 1) const bool GRAYSCALE = false;
+layout(constant_id = 2) const uint COLOR_LEVELS = 0u;
+
 layout(location = 0) in vec3 fragColor;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    vec3 color = fragColor;
+    if (GRAYSCALE) {
+        color = vec3(dot(color, vec3(0.2126, 0.7152, 0.0722)));
+    }
+    if (COLOR_LEVELS > 0u) {
+        color = floor(color * float(COLOR_LEVELS)) / float(COLOR_LEVELS);
+    }
+    outColor = vec4(color, 1.0);
 }
\ No newline at end of file
@@ -1,5 +1,15 @@
 #version 450
 
+// Specialization constants, ids match ShaderConstant in triangle.c
+layout(constant_id = 0) const bool FLIP_Y = false;
+
+// Per draw values, matches DrawConstants in triangle.c
+layout(push_constant) uniform Draw {
+    vec2 offset;
+    float scale;
+    float depth;
+} draw;
+
 layout(location = 0) out vec3 fragColor;
 
 vec2 positions[3] = vec2[](
@@ -15,6 +25,10 @@ vec3 colors[3] = vec3[](
 );
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    vec2 position = positions[gl_VertexIndex];
+    if (FLIP_Y) {
+        position.y = -position.y;
+    }
+    gl_Position = vec4(position * draw.scale + draw.offset, draw.depth, 1.0);
     fragColor = colors[gl_VertexIndex];
 }
\ No newline at end of file
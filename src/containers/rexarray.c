@@ -1,11 +1,11 @@
 #include "rexarray.h"
 #include "core/logger.h"
-#include <stdlib.h>
+#include "core/rexmemory.h"
 #include <string.h>
 
 rexarray _rexarray_create(u32 capacity, u32 stride) {
     u32 total_size = (REXARRAY_FIELD_LENGTH * sizeof(u32)) + (capacity * stride);
-    u32* header = malloc(total_size);
+    u32* header = rexallocate(total_size, MEMORY_TAG_ARRAY);
     header[REXARRAY_CAPACITY] = capacity;
     header[REXARRAY_LENGTH] = 0;
     header[REXARRAY_STRIDE] = stride;
@@ -14,8 +14,7 @@ rexarray _rexarray_create(u32 capacity, u32 stride) {
 
 void rexarray_destroy(rexarray arr) {
     u32* header = (u32*)arr - REXARRAY_FIELD_LENGTH;
-    u32 total_size = (REXARRAY_FIELD_LENGTH * sizeof(u32)) + (header[REXARRAY_CAPACITY] * header[REXARRAY_STRIDE]);
-    free(header);
+    rexfree(header);
 }
 
 u32 _rexarray_field_get(rexarray arr, u32 field) {
@@ -68,10 +67,7 @@ void rexarray_pop_at(rexarray arr, u32 index) {
     u64 addr = (u64)arr + (header[REXARRAY_STRIDE] * (index + 1));
     u32 size = (header[REXARRAY_LENGTH] - (index + 1)) * header[REXARRAY_STRIDE];
     
-    void* buffer = malloc(size);
-    memcpy(buffer, (void*)addr, size);
-    memcpy((void*)(addr - header[REXARRAY_STRIDE]), buffer, size);
-    free(buffer);
+    memmove((void*)(addr - header[REXARRAY_STRIDE]), (void*)addr, size);
 
     header[REXARRAY_LENGTH] -= 1;
 }
\ No newline at end of file
@@ -97,4 +97,10 @@ void rexarray_pop_at(rexarray arr, u32 index);
  * @param rexarray Dynamic array.
  * @returns Array Capacity.
  */
-#define rexarray_capacity(rexarray) _rexarray_field_get(rexarray, REXARRAY_CAPACITY)
\ No newline at end of file
+#define rexarray_capacity(rexarray) _rexarray_field_get(rexarray, REXARRAY_CAPACITY)
+
+/**
+ * Removes every item from the array, keeping its capacity.
+ * @param rexarray Dynamic array.
+ */
+#define rexarray_clear(rexarray) _rexarray_field_set(rexarray, REXARRAY_LENGTH, 0)
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "rexhashmap.h"
+#include "core/rexmemory.h"
+#include <string.h>
+
+#define REXHASHMAP_MIN_CAPACITY 16
+
+static u32 next_power_of_two(u32 value) {
+    u32 result = REXHASHMAP_MIN_CAPACITY;
+    while (result < value) result <<= 1;
+    return result;
+}
+
+void rexhashmap_create(u32 stride, u32 capacity, rexhashmap* out_map) {
+    out_map->capacity = next_power_of_two(capacity);
+    out_map->count = 0;
+    out_map->stride = stride;
+    out_map->keys = rexallocate((u64)out_map->capacity * sizeof(u64), MEMORY_TAG_HASHMAP);
+    memset(out_map->keys, 0, (u64)out_map->capacity * sizeof(u64));
+    out_map->values = rexallocate((u64)out_map->capacity * stride, MEMORY_TAG_HASHMAP);
+}
+
+void rexhashmap_destroy(rexhashmap* map) {
+    rexfree(map->keys);
+    rexfree(map->values);
+    memset(map, 0, sizeof(rexhashmap));
+}
+
+static u32 find_slot(const rexhashmap* map, u64 key) {
+    u32 mask = map->capacity - 1;
+    u32 index = (u32)(key ^ (key >> 32)) & mask;
+    while (map->keys[index] != 0 && map->keys[index] != key) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+void* rexhashmap_get(rexhashmap* map, u64 key) {
+    if (!map->capacity) return 0;
+    u32 index = find_slot(map, key);
+    if (map->keys[index] == 0) return 0;
+    return rexhashmap_value_at(map, index);
+}
+
+static void grow(rexhashmap* map) {
+    rexhashmap bigger;
+    rexhashmap_create(map->stride, map->capacity * 2, &bigger);
+    for (u32 i = 0; i < map->capacity; i++) {
+        if (map->keys[i] != 0) {
+            rexhashmap_insert(&bigger, map->keys[i], rexhashmap_value_at(map, i));
+        }
+    }
+    rexhashmap_destroy(map);
+    *map = bigger;
+}
+
+void* rexhashmap_insert(rexhashmap* map, u64 key, const void* value_ptr) {
+    // Keep the load factor under 3/4 so probe sequences stay short.
+    if ((map->count + 1) * 4 > map->capacity * 3) {
+        grow(map);
+    }
+
+    u32 index = find_slot(map, key);
+    if (map->keys[index] == 0) {
+        map->keys[index] = key;
+        map->count++;
+    }
+
+    void* value = rexhashmap_value_at(map, index);
+    memcpy(value, value_ptr, map->stride);
+    return value;
+}
+
+b8 rexhashmap_remove(rexhashmap* map, u64 key) {
+    if (!map->capacity) return false;
+
+    u32 mask = map->capacity - 1;
+    u32 index = find_slot(map, key);
+    if (map->keys[index] == 0) return false;
+
+    // Backward shift deletion, entries after the hole move back if their probe allows it.
+    u32 hole = index;
+    u32 next = (hole + 1) & mask;
+    while (map->keys[next] != 0) {
+        u32 home = (u32)(map->keys[next] ^ (map->keys[next] >> 32)) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            map->keys[hole] = map->keys[next];
+            memcpy(rexhashmap_value_at(map, hole), rexhashmap_value_at(map, next), map->stride);
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    map->keys[hole] = 0;
+    map->count--;
+    return true;
+}
+
+u64 rexhash_bytes(const void* data, u64 size, u64 seed) {
+    u64 hash = seed ? seed : 0xcbf29ce484222325ull;
+    const u8* bytes = data;
+    for (u64 i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash ? hash : 1;
+}
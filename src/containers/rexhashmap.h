@@ -0,0 +1,59 @@
+#pragma once
+
+#include "defines.h"
+
+/**
+ * Open addressing hash map with linear probing, keyed by 64-bit hashes.
+ * Key 0 marks an empty slot, so callers should hash with rexhash_bytes, which never returns 0.
+ * Values are copied into the map, every value has the same size (stride).
+ */
+typedef struct rexhashmap {
+    u64* keys;
+    u8* values;
+    u32 capacity;
+    u32 count;
+    u32 stride;
+} rexhashmap;
+
+/**
+ * Create a hash map.
+ * @param stride Size of each value in bytes.
+ * @param capacity Initial number of slots, rounded up to a power of two.
+ * @param out_map Hash map to initialize.
+ */
+void rexhashmap_create(u32 stride, u32 capacity, rexhashmap* out_map);
+void rexhashmap_destroy(rexhashmap* map);
+
+/**
+ * Find the value stored under a key.
+ * @returns Pointer to the value inside the map, or 0 if the key is not present.
+ * @note The pointer is invalidated by the next insert.
+ */
+void* rexhashmap_get(rexhashmap* map, u64 key);
+
+/**
+ * Adds a copy of the value under the key, replacing any previous value.
+ * @returns Pointer to the value inside the map.
+ * @note The pointer is invalidated by the next insert.
+ */
+void* rexhashmap_insert(rexhashmap* map, u64 key, const void* value_ptr);
+
+/**
+ * Remove the value stored under a key.
+ * @returns FALSE if the key is not present.
+ */
+b8 rexhashmap_remove(rexhashmap* map, u64 key);
+
+/**
+ * FNV-1a hash of a block of memory.
+ * @param data Data to hash.
+ * @param size Size of the data in bytes.
+ * @param seed Previous hash to chain from, or 0.
+ * @returns A non zero 64-bit hash.
+ */
+u64 rexhash_bytes(const void* data, u64 size, u64 seed);
+
+/**
+ * Returns the value stored in a slot, for iterating with `keys[i] != 0`.
+ */
+#define rexhashmap_value_at(map, index) ((void*)((map)->values + (u64)(index) * (map)->stride))
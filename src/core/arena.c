@@ -0,0 +1,139 @@
+#include "arena.h"
+#include "logger.h"
+#include "rexmemory.h"
+
+#include <string.h>
+
+struct ArenaBlock {
+    ArenaBlock* previous;
+    u64 capacity;
+    u64 offset;
+    u64 total; // Bytes used by this block and the ones before it once it was chained
+};
+
+typedef struct arena_state {
+    Arena frames[2];
+    u32 frame_index;
+    Arena scratch;
+} arena_state;
+
+static arena_state state;
+
+static u8* block_data(ArenaBlock* block) {
+    return (u8*)(block + 1);
+}
+
+static ArenaBlock* block_create(u64 capacity, ArenaBlock* previous) {
+    ArenaBlock* block = rexallocate(sizeof(ArenaBlock) + capacity, MEMORY_TAG_ARENA);
+    if (!block) return 0;
+    block->previous = previous;
+    block->capacity = capacity;
+    block->offset = 0;
+    block->total = previous ? previous->total + previous->offset : 0;
+    return block;
+}
+
+void arena_create(u64 block_size, Arena* out_arena) {
+    out_arena->block_size = block_size;
+    out_arena->block = block_create(block_size, 0);
+}
+
+void arena_destroy(Arena* arena) {
+    ArenaBlock* block = arena->block;
+    while (block) {
+        ArenaBlock* previous = block->previous;
+        rexfree(block);
+        block = previous;
+    }
+    arena->block = 0;
+}
+
+void* arena_alloc(Arena* arena, u64 size, u64 alignment) {
+    ArenaBlock* block = arena->block;
+    // Blocks are aligned for any type, so aligning the offset aligns the pointer.
+    u64 offset = (block->offset + alignment - 1) & ~(alignment - 1);
+
+    if (offset + size > block->capacity) {
+        u64 capacity = arena->block_size;
+        while (capacity < size + alignment) capacity *= 2;
+
+        ArenaBlock* new_block = block_create(capacity, block);
+        if (!new_block) {
+            REXFATAL("arena out of memory, failed to allocate a %llu byte block!", capacity);
+            return 0;
+        }
+        arena->block = block = new_block;
+        offset = 0;
+    }
+
+    block->offset = offset + size;
+    return block_data(block) + offset;
+}
+
+void* arena_alloc_zero(Arena* arena, u64 size, u64 alignment) {
+    void* memory = arena_alloc(arena, size, alignment);
+    if (memory) memset(memory, 0, size);
+    return memory;
+}
+
+void arena_reset(Arena* arena) {
+    ArenaBlock* block = arena->block;
+    if (!block->previous) {
+        block->offset = 0;
+        return;
+    }
+
+    // Outgrew the first block, replace the chain with a single block that fits all of it.
+    u64 used = block->total + block->offset;
+    while (arena->block_size < used) arena->block_size *= 2;
+    arena_destroy(arena);
+    arena->block = block_create(arena->block_size, 0);
+}
+
+ArenaTemp arena_temp_begin(Arena* arena) {
+    return (ArenaTemp){arena, arena->block, arena->block->offset};
+}
+
+void arena_temp_end(ArenaTemp temp) {
+    Arena* arena = temp.arena;
+    while (arena->block != temp.block) {
+        ArenaBlock* previous = arena->block->previous;
+        rexfree(arena->block);
+        arena->block = previous;
+    }
+    arena->block->offset = temp.offset;
+}
+
+b8 arena_initialize(u64 frame_size, u64 scratch_size) {
+    arena_create(frame_size, &state.frames[0]);
+    arena_create(frame_size, &state.frames[1]);
+    arena_create(scratch_size, &state.scratch);
+    state.frame_index = 0;
+
+    if (!state.frames[0].block || !state.frames[1].block || !state.scratch.block) {
+        REXFATAL("failed to allocate arenas!");
+        arena_shutdown();
+        return false;
+    }
+
+    return true;
+}
+
+void arena_shutdown() {
+    arena_destroy(&state.frames[0]);
+    arena_destroy(&state.frames[1]);
+    arena_destroy(&state.scratch);
+}
+
+void arena_begin_frame() {
+    state.frame_index ^= 1;
+    arena_reset(&state.frames[state.frame_index]);
+}
+
+Arena* arena_frame() {
+    return &state.frames[state.frame_index];
+}
+
+Arena* arena_scratch() {
+    return &state.scratch;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "defines.h"
+
+/*
+ * Linear allocators. Allocating bumps an offset and nothing is freed on its own, the whole
+ * arena is reset at once or rolled back to a point saved with arena_temp_begin. When a block
+ * runs out another one is chained, and a reset folds the chain back into a single block large
+ * enough for everything, so a steady workload settles on one block and never calls malloc.
+ *
+ * Two arenas are provided, neither is thread safe and both belong to the main thread:
+ * - The frame arenas, for data that lives until the end of the next frame. There are two,
+ *   arena_begin_frame swaps them and resets the one becoming current, so data from the
+ *   previous frame stays valid while the current one is built.
+ * - The scratch arena, for temporaries of a single function or init step, always used inside
+ *   an arena_temp_begin/arena_temp_end pair.
+ */
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock* block; // Newest block, allocations come from here
+    u64 block_size;    // Minimum size of a new block
+} Arena;
+
+// Saved position of an arena, see arena_temp_begin.
+typedef struct ArenaTemp {
+    Arena* arena;
+    ArenaBlock* block;
+    u64 offset;
+} ArenaTemp;
+
+/**
+ * @param block_size Size of the first block, and the minimum size of chained ones.
+ * @param out_arena The arena to create.
+ */
+void arena_create(u64 block_size, Arena* out_arena);
+void arena_destroy(Arena* arena);
+
+/**
+ * @param arena The arena to allocate from.
+ * @param size Size in bytes.
+ * @param alignment Power of two.
+ * @returns Uninitialized memory, valid until the arena is reset or rolled back past it.
+ */
+void* arena_alloc(Arena* arena, u64 size, u64 alignment);
+
+// Same as arena_alloc, with the memory zeroed.
+void* arena_alloc_zero(Arena* arena, u64 size, u64 alignment);
+
+// Frees everything allocated from the arena.
+void arena_reset(Arena* arena);
+
+/**
+ * Saves the position of the arena, everything allocated after it is freed by arena_temp_end.
+ * Scopes nest like a stack.
+ */
+ArenaTemp arena_temp_begin(Arena* arena);
+void arena_temp_end(ArenaTemp temp);
+
+/**
+ * Allocates an array from an arena.
+ * @param arena Arena pointer.
+ * @param type Element type.
+ * @param count Number of elements.
+ */
+#define ARENA_PUSH(arena, type, count) ((type*)arena_alloc(arena, sizeof(type) * (count), _Alignof(type)))
+#define ARENA_PUSH_ZERO(arena, type, count) ((type*)arena_alloc_zero(arena, sizeof(type) * (count), _Alignof(type)))
+
+/**
+ * Creates the frame and scratch arenas.
+ * @param frame_size Initial block size of each frame arena.
+ * @param scratch_size Initial block size of the scratch arena.
+ */
+b8 arena_initialize(u64 frame_size, u64 scratch_size);
+void arena_shutdown();
+
+// Called once at the start of every frame, frees what was allocated two frames ago.
+void arena_begin_frame();
+
+// The current frame arena.
+Arena* arena_frame();
+
+// The scratch arena, only use it within arena_temp_begin and arena_temp_end.
+Arena* arena_scratch();
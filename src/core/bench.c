@@ -0,0 +1,224 @@
+#include "bench.h"
+#include "logger.h"
+#include "rexmemory.h"
+#include "telemetry.h"
+#include "platform/platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESULTS_SIZE 4096
+// Results files are small, anything larger is not one.
+#define MAX_BASELINE_SIZE (64 * 1024)
+
+typedef struct bench_state {
+    BenchConfig config;
+    u32 frame;
+    f64 start_time; // When the first measured frame started
+    f64 end_time;
+    b8 active;
+} bench_state;
+
+// Compared against the baseline, the rest of the results is informational.
+typedef struct bench_check {
+    const char* object; // 0 for a top level value
+    const char* key;
+    b8 higher_is_better;
+} bench_check;
+
+static bench_state state;
+
+static const bench_check checks[] = {
+    {0, "fps", true},
+    {"cpu_frame", "p50_ms", false},
+    {"cpu_frame", "p95_ms", false},
+    {"gpu", "p50_ms", false},
+    {"gpu", "p95_ms", false},
+    {0, "peak_memory_bytes", false},
+};
+
+static void start_measuring() {
+    telemetry_reset();
+    state.start_time = platform_get_absolute_time();
+}
+
+// Device names are the only strings that aren't ours, quotes and backslashes are escaped.
+static u32 append_string(char* buffer, u32 length, const char* string) {
+    buffer[length++] = '"';
+    for (const char* c = string; *c && length < RESULTS_SIZE - 3; c++) {
+        if (*c == '"' || *c == '\\') buffer[length++] = '\\';
+        buffer[length++] = *c;
+    }
+    buffer[length++] = '"';
+    buffer[length] = 0;
+    return length;
+}
+
+// Single line of JSON, the same layout every run so results diff cleanly.
+static void format_results(const char* device, const char* present_mode, char* out_results) {
+    f64 seconds = state.end_time - state.start_time;
+    MemoryTagStats memory;
+    memory_get_total_stats(&memory);
+
+    u32 length = snprintf(out_results, RESULTS_SIZE, "{\"device\":");
+    length = append_string(out_results, length, device);
+    length += snprintf(out_results + length, RESULTS_SIZE - length, ",\"present_mode\":");
+    length = append_string(out_results, length, present_mode);
+    length += snprintf(out_results + length, RESULTS_SIZE - length,
+                       ",\"frames\":%u,\"warmup_frames\":%u,\"seconds\":%.3f,\"fps\":%.2f,\"peak_memory_bytes\":%llu",
+                       state.config.frames, state.config.warmup_frames, seconds, seconds > 0 ? state.config.frames / seconds : 0,
+                       memory.peak_bytes);
+
+    for (u32 metric = 0; metric < TELEMETRY_METRIC_COUNT; metric++) {
+        TelemetrySummary summary;
+        telemetry_get_summary(metric, &summary);
+        if (!summary.count) continue;
+
+        length += snprintf(out_results + length, RESULTS_SIZE - length,
+                           ",\"%s\":{\"count\":%llu,\"mean_ms\":%.3f,\"p50_ms\":%.3f,\"p95_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}",
+                           telemetry_metric_name(metric), summary.count, summary.mean * 1e3, summary.p50 * 1e3,
+                           summary.p95 * 1e3, summary.p99 * 1e3, summary.max * 1e3);
+    }
+    snprintf(out_results + length, RESULTS_SIZE - length, "}");
+}
+
+// Value of a key of the results, inside the given object or at the top level. Only meant for
+// files written by format_results.
+static b8 find_number(const char* results, const char* object, const char* key, f64* out_value) {
+    char pattern[64];
+    const char* start = results;
+    const char* end = 0;
+    if (object) {
+        snprintf(pattern, sizeof(pattern), "\"%s\":{", object);
+        start = strstr(results, pattern);
+        if (!start) return false;
+        end = strchr(start, '}');
+    }
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char* found = strstr(start, pattern);
+    if (!found || (end && found > end)) return false;
+
+    *out_value = strtod(found + strlen(pattern), 0);
+    return true;
+}
+
+static char* read_baseline(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return 0;
+
+    char* baseline = rexallocate(MAX_BASELINE_SIZE + 1, MEMORY_TAG_UNKNOWN);
+    u64 size = fread(baseline, 1, MAX_BASELINE_SIZE, file);
+    baseline[size] = 0;
+    fclose(file);
+    return baseline;
+}
+
+static b8 compare_to_baseline(const char* results) {
+    char* baseline = read_baseline(state.config.baseline_path);
+    if (!baseline) {
+        REXERROR("failed to read benchmark baseline [%s]!", state.config.baseline_path);
+        return false;
+    }
+
+    b8 passed = true;
+    REXINFO("Compared to %s, failing past %.1f%%:", state.config.baseline_path, state.config.regression_threshold * 100.0);
+    for (u32 i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        const bench_check* check = &checks[i];
+        f64 baseline_value, value;
+        if (!find_number(baseline, check->object, check->key, &baseline_value) ||
+            !find_number(results, check->object, check->key, &value) || baseline_value <= 0) {
+            continue;
+        }
+
+        // Positive is worse, whichever way the metric goes.
+        f64 change = (value - baseline_value) / baseline_value;
+        f64 regression = check->higher_is_better ? -change : change;
+        const char* object = check->object ? check->object : "";
+        const char* separator = check->object ? "." : "";
+        if (regression > state.config.regression_threshold) {
+            REXERROR("  %s%s%s %.3f -> %.3f (%+.1f%%) regressed", object, separator, check->key, baseline_value, value, change * 100.0);
+            passed = false;
+        } else {
+            REXINFO("  %s%s%s %.3f -> %.3f (%+.1f%%)", object, separator, check->key, baseline_value, value, change * 100.0);
+        }
+    }
+
+    rexfree(baseline);
+    return passed;
+}
+
+b8 bench_initialize(const BenchConfig* config) {
+    memset(&state, 0, sizeof(bench_state));
+    state.config = *config;
+    if (!state.config.frames) {
+        REXERROR("a benchmark needs at least one frame!");
+        return false;
+    }
+
+    state.active = true;
+
+    REXINFO("Benchmarking %u frames after %u warmup frames", state.config.frames, state.config.warmup_frames);
+    return true;
+}
+
+b8 bench_active() {
+    return state.active;
+}
+
+void bench_begin_frame() {
+    if (state.active && state.frame == state.config.warmup_frames) start_measuring();
+}
+
+b8 bench_end_frame() {
+    if (!state.active) return true;
+
+    state.frame++;
+    if (state.frame < state.config.warmup_frames + state.config.frames) return true;
+
+    state.end_time = platform_get_absolute_time();
+    return false;
+}
+
+b8 bench_finish(const char* device, const char* present_mode) {
+    if (!state.active) return true;
+    state.active = false;
+
+    u32 total_frames = state.config.warmup_frames + state.config.frames;
+    if (state.frame < total_frames) {
+        REXERROR("benchmark stopped after %u of %u frames!", state.frame, total_frames);
+        return false;
+    }
+
+    char results[RESULTS_SIZE];
+    format_results(device, present_mode, results);
+
+    f64 fps = 0, cpu_frame = 0, gpu = 0;
+    find_number(results, 0, "fps", &fps);
+    find_number(results, "cpu_frame", "mean_ms", &cpu_frame);
+    find_number(results, "gpu", "mean_ms", &gpu);
+    REXINFO("Benchmark on %s, %s: %u frames, %.2f fps", device, present_mode, state.config.frames, fps);
+    if (cpu_frame > 0 && gpu > 0) {
+        REXINFO("  GPU busy %.1f%% of the frame, %.3f of %.3f ms", gpu / cpu_frame * 100.0, gpu, cpu_frame);
+    }
+    // Unprefixed on stdout, for scripts to pick up.
+    printf("%s\n", results);
+    fflush(stdout);
+
+    b8 passed = true;
+    if (state.config.results_path) {
+        FILE* file = fopen(state.config.results_path, "w");
+        if (file) {
+            fprintf(file, "%s\n", results);
+            fclose(file);
+            REXINFO("Benchmark results written to %s", state.config.results_path);
+        } else {
+            REXERROR("failed to write benchmark results [%s]!", state.config.results_path);
+            passed = false;
+        }
+    }
+
+    if (state.config.baseline_path && !compare_to_baseline(results)) passed = false;
+    return passed;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "defines.h"
+
+/*
+ * Fixed length benchmark runs. Warmup frames are rendered first and left out, then the
+ * telemetry of the measured frames is summarized, written as JSON and optionally compared
+ * against the results of an earlier run.
+ */
+
+typedef struct BenchConfig {
+    u32 frames;                 // Measured frames
+    u32 warmup_frames;          // Rendered before and discarded
+    const char* results_path;   // JSON results, 0 to only log them
+    const char* baseline_path;  // Results of an earlier run to compare against, 0 for none
+    f64 regression_threshold;   // How much worse a metric may get, 0.05 for 5%
+} BenchConfig;
+
+// Copied, telemetry must be initialized.
+b8 bench_initialize(const BenchConfig* config);
+
+// TRUE from bench_initialize until bench_finish.
+b8 bench_active();
+
+// Called at the start of every frame, before anything of it is measured.
+void bench_begin_frame();
+
+/**
+ * Called once per frame, after telemetry_end_frame. Does nothing outside of a benchmark.
+ * @returns FALSE once every frame was measured and the application should stop.
+ */
+b8 bench_end_frame();
+
+/**
+ * Logs and writes the results and compares them against the baseline.
+ * @param device Name of the GPU, copied into the results.
+ * @param present_mode How frames were presented, copied into the results.
+ * @returns FALSE if not every frame was measured, the results couldn't be written or a metric
+ * regressed past the threshold.
+ */
+b8 bench_finish(const char* device, const char* present_mode);
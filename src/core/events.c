@@ -1,68 +1,454 @@
 #include "events.h"
 #include "logger.h"
+#include "rexmemory.h"
 #include "containers/rexarray.h"
 
+#include <stdatomic.h>
+#include <string.h>
+#include <threads.h>
+
 typedef struct registered_listener {
-    void* linstener;
+    void* listener;
     PFN_on_event callback;
+    // Subscription slot, the entry is dead once the slot's generation moves on.
+    u32 slot;
+    u32 generation;
 } registered_listener;
 
-typedef struct registered_event {
+// Subscriptions are allocated in pages that never move, so event_fire can read a slot while
+// another thread adds a page.
+#define SUBSCRIPTION_PAGE_SIZE 1024
+#define SUBSCRIPTION_MAX_PAGES 64
+#define NO_FREE_SLOT 0xFFFFFFFF
+
+typedef struct subscription_slot {
+    _Atomic u32 generation;
+    u32 next_free;
+} subscription_slot;
+
+// Listeners of one code, a slice of the registry's listener pool.
+typedef struct event_span {
+    u16 code;
+    b8 used;
+    b8 coalesce;
+    u32 first;
+    u32 count;
+} event_span;
+
+// Every listener lives in one allocation: the header, a small open addressing table from
+// code to span, then the listener pool with each code's listeners next to each other.
+// Never modified once published, registering builds a new copy (RCU style), so event_fire
+// can walk it without a lock while another thread registers.
+typedef struct event_registry {
+    u32 span_capacity; // power of two
+    u32 listener_count;
+    event_span* spans;
     registered_listener* listeners;
-} registered_event;
+} event_registry;
+
+#define REGISTRY_MIN_SPANS 16
+
+typedef struct queued_event {
+    u16 code;
+    void* sender;
+    EventContext data;
+} queued_event;
+
+// Size of the queue for events posted from other threads, must be a power of two.
+#define THREAD_QUEUE_SIZE 1024
 
-#define MAX_EVENT_CODE 4096
+// Bounded lock-free queue cell, see event_post_threadsafe.
+typedef struct thread_queue_cell {
+    _Atomic u64 sequence;
+    queued_event event;
+} thread_queue_cell;
 
 typedef struct events_state {
-    registered_event events[MAX_EVENT_CODE];
+    _Atomic(event_registry*) registry;
+
+    // Posted events, swapped on dispatch so listeners can post for the next frame.
+    queued_event* queues[2]; // rexarray
+    u32 post_queue;
+
+    // Multi producer, single consumer queue drained by event_dispatch_queued.
+    thread_queue_cell thread_queue[THREAD_QUEUE_SIZE];
+    _Atomic u64 thread_enqueue_pos;
+    u64 thread_dequeue_pos;
+
+    // Only writers take the lock. Replaced registries are freed once no event_fire is running.
+    mtx_t write_mutex;
+    event_registry** retired; // rexarray
+    _Atomic u32 readers;
+
+    subscription_slot* slot_pages[SUBSCRIPTION_MAX_PAGES];
+    u32 slot_count;
+    u32 first_free_slot; // NO_FREE_SLOT when empty
+    // Unregistered entries still in the registry, compacted on the next dispatch.
+    u32 dead_listeners;
 } events_state;
 
 static events_state state;
 
 b8 event_initialize() {
+    state.queues[0] = REXARRAY(queued_event);
+    state.queues[1] = REXARRAY(queued_event);
+    state.post_queue = 0;
+
+    for (u32 i = 0; i < THREAD_QUEUE_SIZE; i++) {
+        atomic_init(&state.thread_queue[i].sequence, i);
+    }
+    atomic_init(&state.thread_enqueue_pos, 0);
+    state.thread_dequeue_pos = 0;
+
+    mtx_init(&state.write_mutex, mtx_plain);
+    state.retired = REXARRAY(event_registry*);
+    atomic_init(&state.readers, 0);
+    state.slot_count = 0;
+    state.first_free_slot = NO_FREE_SLOT;
+    state.dead_listeners = 0;
+
+    event_set_coalescing(EVENT_CODE_RESIZED, true);
+    event_set_coalescing(EVENT_CODE_MOUSE_MOVED, true);
+
     REXINFO("Events system initialized!");
     return true;
 }
 
+static void free_retired_registries() {
+    for (u32 i = 0; i < rexarray_len(state.retired); i++) {
+        rexfree(state.retired[i]);
+    }
+    rexarray_clear(state.retired);
+}
+
 void event_shutdown() {
-    for (u16 i = 0; i < MAX_EVENT_CODE; i++)
-    {
-        if (state.events[i].listeners != 0) {
-            rexarray_destroy(state.events[i].listeners);
+    rexfree(atomic_load(&state.registry));
+    atomic_store(&state.registry, 0);
+
+    free_retired_registries();
+    rexarray_destroy(state.retired);
+
+    for (u32 i = 0; i < SUBSCRIPTION_MAX_PAGES; i++) {
+        rexfree(state.slot_pages[i]);
+        state.slot_pages[i] = 0;
+    }
+    mtx_destroy(&state.write_mutex);
+
+    rexarray_destroy(state.queues[0]);
+    rexarray_destroy(state.queues[1]);
+}
+
+static u32 span_home(u16 code, u32 mask) {
+    return (code * 2654435761u >> 16) & mask;
+}
+
+static const event_span* find_span(const event_registry* registry, u16 code) {
+    if (!registry) return 0;
+
+    u32 mask = registry->span_capacity - 1;
+    for (u32 index = span_home(code, mask); registry->spans[index].used; index = (index + 1) & mask) {
+        if (registry->spans[index].code == code) {
+            return &registry->spans[index];
+        }
+    }
+    return 0;
+}
+
+static event_span* insert_span(event_registry* registry, u16 code) {
+    u32 mask = registry->span_capacity - 1;
+    u32 index = span_home(code, mask);
+    while (registry->spans[index].used) {
+        index = (index + 1) & mask;
+    }
+    event_span* span = &registry->spans[index];
+    span->code = code;
+    span->used = true;
+    return span;
+}
+
+static subscription_slot* get_slot(u32 slot) {
+    return &state.slot_pages[slot / SUBSCRIPTION_PAGE_SIZE][slot % SUBSCRIPTION_PAGE_SIZE];
+}
+
+static b8 listener_alive(const registered_listener* entry) {
+    return atomic_load_explicit(&get_slot(entry->slot)->generation, memory_order_acquire) == entry->generation;
+}
+
+// Describes a single change applied while copying the registry.
+typedef struct registry_edit {
+    u16 code;
+    const registered_listener* add; // appended to the code's listeners
+    i8 coalesce; // -1 keeps the current setting
+} registry_edit;
+
+// Copies the registry, applying the edit (can be 0) and dropping unregistered listeners.
+// Must be called with the write lock held.
+static event_registry* build_registry(const event_registry* old, const registry_edit* edit) {
+    const event_span* edited = edit ? find_span(old, edit->code) : 0;
+
+    u32 span_count = 0;
+    if (old) {
+        for (u32 i = 0; i < old->span_capacity; i++) {
+            span_count += old->spans[i].used;
         }
     }
+    if (edit && !edited) span_count++;
+
+    u32 span_capacity = REGISTRY_MIN_SPANS;
+    while (span_capacity < span_count * 2) span_capacity <<= 1;
+
+    u32 max_listeners = (old ? old->listener_count : 0) + (edit && edit->add ? 1 : 0);
+
+    u64 spans_size = sizeof(event_span) * span_capacity;
+    event_registry* registry = rexallocate(sizeof(event_registry) + spans_size + sizeof(registered_listener) * max_listeners, MEMORY_TAG_EVENTS);
+    registry->span_capacity = span_capacity;
+    registry->spans = (event_span*)(registry + 1);
+    registry->listeners = (registered_listener*)((u8*)registry->spans + spans_size);
+    memset(registry->spans, 0, spans_size);
+
+    // Copy span by span so every code's listeners stay contiguous, applying the edit on the way.
+    u32 cursor = 0;
+    u32 old_capacity = old ? old->span_capacity : 0;
+    for (u32 i = 0; i <= old_capacity; i++) {
+        event_span source = {0};
+        if (i < old_capacity) {
+            if (!old->spans[i].used) continue;
+            source = old->spans[i];
+        } else if (!edit || edited) {
+            break;
+        } else {
+            source = (event_span){edit->code, true, false, 0, 0};
+        }
+
+        b8 is_edited = edit && source.code == edit->code;
+        b8 coalesce = is_edited && edit->coalesce >= 0 ? edit->coalesce : source.coalesce;
+
+        u32 first = cursor;
+        for (u32 j = 0; j < source.count; j++) {
+            const registered_listener* entry = &old->listeners[source.first + j];
+            if (listener_alive(entry)) {
+                registry->listeners[cursor++] = *entry;
+            }
+        }
+        if (is_edited && edit->add) {
+            registry->listeners[cursor++] = *edit->add;
+        }
+
+        // Codes nobody listens to are dropped, unless they carry a setting.
+        if (cursor == first && !coalesce) continue;
+
+        event_span* span = insert_span(registry, source.code);
+        span->coalesce = coalesce;
+        span->first = first;
+        span->count = cursor - first;
+    }
+
+    registry->listener_count = cursor;
+    state.dead_listeners = 0;
+    return registry;
 }
 
-void event_register(u16 code, void* listener, PFN_on_event on_event) {
-    if(state.events[code].listeners == 0) {
-        state.events[code].listeners = REXARRAY(registered_listener);
+// Must be called with the write lock held.
+static void publish_registry(event_registry* registry) {
+    event_registry* old = atomic_exchange(&state.registry, registry);
+    if (old) {
+        rexarray_push(state.retired, &old);
     }
 
-    registered_listener lis = {listener, on_event};
-    rexarray_push(state.events[code].listeners, &lis);
+    // A reader announces itself before loading the registry, so with no readers after the
+    // exchange nobody can still hold a replaced one.
+    if (atomic_load(&state.readers) == 0) {
+        free_retired_registries();
+    }
 }
 
-b8 event_unregister(u16 code, PFN_on_event on_event) {
-    for (u16 i = 0; i < rexarray_len(state.events[code].listeners); i++)
-    {
-        if(state.events[code].listeners[i].callback == on_event) {
-            rexarray_pop_at(state.events[code].listeners, i);
-            return true;
+// Must be called with the write lock held.
+static b8 allocate_slot(u32* out_slot) {
+    if (state.first_free_slot != NO_FREE_SLOT) {
+        *out_slot = state.first_free_slot;
+        state.first_free_slot = get_slot(*out_slot)->next_free;
+        return true;
+    }
+
+    u32 page = state.slot_count / SUBSCRIPTION_PAGE_SIZE;
+    if (page == SUBSCRIPTION_MAX_PAGES) {
+        return false;
+    }
+    if (!state.slot_pages[page]) {
+        state.slot_pages[page] = rexallocate(sizeof(subscription_slot) * SUBSCRIPTION_PAGE_SIZE, MEMORY_TAG_EVENTS);
+        for (u32 i = 0; i < SUBSCRIPTION_PAGE_SIZE; i++) {
+            atomic_init(&state.slot_pages[page][i].generation, 0);
         }
     }
-    return false;
+
+    *out_slot = state.slot_count++;
+    return true;
+}
+
+EventHandle event_register(u16 code, void* listener, PFN_on_event on_event) {
+    mtx_lock(&state.write_mutex);
+
+    u32 slot;
+    if (!allocate_slot(&slot)) {
+        mtx_unlock(&state.write_mutex);
+        REXERROR("event_register: out of subscriptions, code %i not registered", code);
+        return (EventHandle){0};
+    }
+
+    // Generation 0 is never handed out, so a zeroed handle is always invalid.
+    subscription_slot* subscription = get_slot(slot);
+    u32 generation = atomic_load(&subscription->generation) + 1;
+    if (generation == 0) generation = 1;
+    atomic_store(&subscription->generation, generation);
+
+    registered_listener entry = {listener, on_event, slot, generation};
+    registry_edit edit = {code, &entry, -1};
+    publish_registry(build_registry(atomic_load(&state.registry), &edit));
+
+    mtx_unlock(&state.write_mutex);
+    return (EventHandle){slot, generation};
+}
+
+b8 event_unregister(EventHandle handle) {
+    if (handle.generation == 0) return false;
+
+    mtx_lock(&state.write_mutex);
+
+    if (handle.slot >= state.slot_count || atomic_load(&get_slot(handle.slot)->generation) != handle.generation) {
+        mtx_unlock(&state.write_mutex);
+        return false;
+    }
+
+    // Bumping the generation kills the registry entry right away, event_fire skips it even if
+    // it is dispatching this code right now. The entry itself is dropped on the next dispatch.
+    subscription_slot* subscription = get_slot(handle.slot);
+    atomic_store_explicit(&subscription->generation, handle.generation + 1 ? handle.generation + 1 : 1, memory_order_release);
+    subscription->next_free = state.first_free_slot;
+    state.first_free_slot = handle.slot;
+    state.dead_listeners++;
+
+    mtx_unlock(&state.write_mutex);
+    return true;
 }
 
 b8 event_fire(u16 code, void* sender, EventContext data) {
-    if (state.events[code].listeners ==  0) return false;
-    
-    for (u16 i = 0; i < rexarray_len(state.events[code].listeners); i++)
-    {
-        if (state.events[code].listeners[i].callback(code, sender, data))
+    // Announce the reader before loading the registry, so one it may see is never freed under it.
+    atomic_fetch_add(&state.readers, 1);
+    event_registry* registry = atomic_load(&state.registry);
+    const event_span* span = find_span(registry, code);
+
+    b8 handled = false;
+    if (span) {
+        const registered_listener* listeners = registry->listeners + span->first;
+        for (u32 i = 0; i < span->count; i++)
         {
-            return true;
+            if (!listener_alive(&listeners[i])) {
+                continue;
+            }
+            if (listeners[i].callback(code, sender, data))
+            {
+                handled = true;
+                break;
+            }
+        }
+    }
+
+    atomic_fetch_sub(&state.readers, 1);
+    return handled;
+}
+
+void event_post(u16 code, void* sender, EventContext data) {
+    queued_event* queue = state.queues[state.post_queue];
+
+    atomic_fetch_add(&state.readers, 1);
+    const event_span* span = find_span(atomic_load(&state.registry), code);
+    b8 coalesce = span && span->coalesce;
+    atomic_fetch_sub(&state.readers, 1);
+
+    if (coalesce) {
+        for (u32 i = rexarray_len(queue); i > 0; i--) {
+            if (queue[i - 1].code == code && queue[i - 1].sender == sender) {
+                queue[i - 1].data = data;
+                return;
+            }
+        }
+    }
+
+    queued_event event = {code, sender, data};
+    rexarray_push(state.queues[state.post_queue], &event);
+}
+
+b8 event_post_threadsafe(u16 code, void* sender, EventContext data) {
+    // Bounded queue after Dmitry Vyukov, each cell's sequence says whose turn it is.
+    u64 pos = atomic_load_explicit(&state.thread_enqueue_pos, memory_order_relaxed);
+    thread_queue_cell* cell;
+    for (;;) {
+        cell = &state.thread_queue[pos & (THREAD_QUEUE_SIZE - 1)];
+        u64 sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        i64 diff = (i64)sequence - (i64)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&state.thread_enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Full, the main thread hasn't dispatched for a while.
+            return false;
+        } else {
+            pos = atomic_load_explicit(&state.thread_enqueue_pos, memory_order_relaxed);
         }
     }
 
-    return false;
-}
\ No newline at end of file
+    cell->event = (queued_event){code, sender, data};
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+static void drain_thread_queue() {
+    for (;;) {
+        thread_queue_cell* cell = &state.thread_queue[state.thread_dequeue_pos & (THREAD_QUEUE_SIZE - 1)];
+        u64 sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        if (sequence != state.thread_dequeue_pos + 1) {
+            return;
+        }
+
+        queued_event event = cell->event;
+        atomic_store_explicit(&cell->sequence, state.thread_dequeue_pos + THREAD_QUEUE_SIZE, memory_order_release);
+        state.thread_dequeue_pos++;
+
+        event_post(event.code, event.sender, event.data);
+    }
+}
+
+void event_dispatch_queued() {
+    drain_thread_queue();
+
+    u32 dispatch_queue = state.post_queue;
+    state.post_queue = !state.post_queue;
+
+    queued_event* queue = state.queues[dispatch_queue];
+    u32 count = rexarray_len(queue);
+    for (u32 i = 0; i < count; i++) {
+        event_fire(queue[i].code, queue[i].sender, queue[i].data);
+    }
+    rexarray_clear(state.queues[dispatch_queue]);
+
+    // Once per frame is enough to drop unregistered listeners and to free registries replaced
+    // while something was firing.
+    mtx_lock(&state.write_mutex);
+    if (state.dead_listeners) {
+        publish_registry(build_registry(atomic_load(&state.registry), 0));
+    }
+    if (rexarray_len(state.retired) && atomic_load(&state.readers) == 0) {
+        free_retired_registries();
+    }
+    mtx_unlock(&state.write_mutex);
+}
+
+void event_set_coalescing(u16 code, b8 coalesce) {
+    mtx_lock(&state.write_mutex);
+
+    registry_edit edit = {code, 0, coalesce ? 1 : 0};
+    publish_registry(build_registry(atomic_load(&state.registry), &edit));
+
+    mtx_unlock(&state.write_mutex);
+}
@@ -24,29 +24,37 @@ typedef struct EventContext {
 
 typedef b8 (*PFN_on_event)(u16 code, void* sender, EventContext data);
 
+// Identifies one registration, returned by event_register. A zeroed handle is never valid.
+typedef struct EventHandle {
+    u32 slot;
+    u32 generation;
+} EventHandle;
+
 b8 event_initialize();
 void event_shutdown();
 
 /**
- * Register to listen for when events are sent with the provided code.
+ * Register to listen for when events are sent with the provided code. Safe to call from any
+ * thread, events already being fired keep the listeners they started with.
  * @param code The event code to listen for.
  * @param listener A pointer to a listener instance. Can be 0/NULL.
  * @param on_event The callback function pointer to be invoked when the event code is fired.
+ * @returns A handle for event_unregister, zeroed if the registration failed.
  */
-void event_register(u16 code, void* listener, PFN_on_event on_event);
+EventHandle event_register(u16 code, void* listener, PFN_on_event on_event);
 
 /**
- * Unregister from listening for when events are sent with the provided code. If no matching
- * registration is found, this function returns FALSE.
- * @param code The event code to stop listening for.
- * @param on_event The callback function pointer to be unregistered.
- * @returns FALSE if the event is not registered.
+ * Unregister a single registration in constant time. Safe to call from any thread and from
+ * inside a listener, the listener is not called again even by an event already being fired.
+ * @param handle The handle returned by event_register.
+ * @returns FALSE if the handle was already unregistered or is invalid.
  */
-b8 event_unregister(u16 code, PFN_on_event on_event);
+b8 event_unregister(EventHandle handle);
 
 /**
  * Fires an event to listeners of the given code. If an event handler returns 
  * TRUE, the event is considered handled and is not passed on to any more listeners.
+ * Never takes a lock, listeners run on the calling thread.
  * @param code The event code to fire.
  * @param sender A pointer to the sender. Can be 0/NULL.
  * @param data The event data.
@@ -54,6 +62,42 @@ b8 event_unregister(u16 code, PFN_on_event on_event);
  */
 b8 event_fire(u16 code, void* sender, EventContext data);
 
+/**
+ * Queues an event to be fired by the next event_dispatch_queued call instead of firing it
+ * right away. Events posted while dispatching are kept for the next dispatch.
+ * Main thread only, other threads use event_post_threadsafe.
+ * @param code The event code to post.
+ * @param sender A pointer to the sender. Can be 0/NULL.
+ * @param data The event data.
+ */
+void event_post(u16 code, void* sender, EventContext data);
+
+/**
+ * Queues an event from any thread, without taking a lock. The event is fired on the main
+ * thread by the next event_dispatch_queued call. Coalescing applies once it reaches the main
+ * thread.
+ * @param code The event code to post.
+ * @param sender A pointer to the sender. Can be 0/NULL.
+ * @param data The event data.
+ * @returns FALSE if the queue is full and the event was dropped.
+ */
+b8 event_post_threadsafe(u16 code, void* sender, EventContext data);
+
+/**
+ * Fires every queued event, in the order they were posted. Called once per frame on the main
+ * thread.
+ */
+void event_dispatch_queued();
+
+/**
+ * When enabled, posting an event replaces the data of an event with the same code and sender
+ * that is still queued, so listeners only see the latest one. Enabled by default for
+ * EVENT_CODE_RESIZED and EVENT_CODE_MOUSE_MOVED.
+ * @param code The event code.
+ * @param coalesce TRUE to coalesce queued events of this code.
+ */
+void event_set_coalescing(u16 code, b8 coalesce);
+
 // System internal event codes. Application should use codes beyond 255.
 typedef enum SystemEventCode {
     // Shuts the application down on the next frame.
@@ -96,7 +140,7 @@ typedef enum SystemEventCode {
      */
     EVENT_CODE_MOUSE_WHEEL = 0x07,
 
-    // Resized/resolution changed from the OS.
+    // Resized/resolution changed from the OS. The size is in pixels, see platform_get_framebuffer_size.
     /* Context usage:
      * u16 width = data.data.u16[0];
      * u16 height = data.data.u16[1];
@@ -0,0 +1,210 @@
+#include "input.h"
+#include "events.h"
+#include "logger.h"
+
+#include <string.h>
+
+#define KEY_WORDS (KEY_MAX_KEYS / 64)
+
+typedef struct keyboard_state {
+    u64 keys[KEY_WORDS]; // one bit per key
+} keyboard_state;
+
+typedef struct mouse_state {
+    i32 x;
+    i32 y;
+    i32 delta_x;
+    i32 delta_y;
+    i32 wheel;
+    u8 buttons; // one bit per button
+} mouse_state;
+
+typedef struct input_state {
+    // Written by the platform layer while processing messages.
+    keyboard_state pending_keyboard;
+    mouse_state pending_mouse;
+    // Pressed since the last update, so a tap shorter than a frame still shows up as down.
+    keyboard_state pending_key_taps;
+    u8 pending_button_taps;
+
+    // What the frame polls, swapped in by input_update.
+    keyboard_state keyboard_current;
+    keyboard_state keyboard_previous;
+    mouse_state mouse_current;
+    mouse_state mouse_previous;
+} input_state;
+
+static b8 initialized = false;
+static input_state state;
+
+static b8 key_bit(const keyboard_state* keyboard, u32 key) {
+    return (keyboard->keys[key / 64] >> (key % 64)) & 1;
+}
+
+b8 input_initialize() {
+    memset(&state, 0, sizeof(input_state));
+    initialized = true;
+    REXINFO("Input system initialized!");
+    return true;
+}
+
+void input_shutdown() {
+    initialized = false;
+}
+
+void input_update() {
+    if (!initialized) return;
+
+    state.keyboard_previous = state.keyboard_current;
+    state.keyboard_current = state.pending_keyboard;
+    state.mouse_previous = state.mouse_current;
+    state.mouse_current = state.pending_mouse;
+
+    for (u32 word = 0; word < KEY_WORDS; word++) {
+        state.keyboard_current.keys[word] |= state.pending_key_taps.keys[word];
+    }
+    state.mouse_current.buttons |= state.pending_button_taps;
+    memset(&state.pending_key_taps, 0, sizeof(keyboard_state));
+    state.pending_button_taps = 0;
+
+    // Deltas are per frame, positions and held buttons carry over.
+    state.pending_mouse.delta_x = 0;
+    state.pending_mouse.delta_y = 0;
+    state.pending_mouse.wheel = 0;
+
+    EventContext ctx = {0};
+    for (u32 word = 0; word < KEY_WORDS; word++) {
+        u64 changed = state.keyboard_current.keys[word] ^ state.keyboard_previous.keys[word];
+        while (changed) {
+            u32 bit = __builtin_ctzll(changed);
+            changed &= changed - 1;
+
+            u16 key = word * 64 + bit;
+            ctx.data.u16[0] = key;
+            event_post(key_bit(&state.keyboard_current, key) ? EVENT_CODE_KEY_PRESSED : EVENT_CODE_KEY_RELEASED, 0, ctx);
+        }
+    }
+
+    u8 changed_buttons = state.mouse_current.buttons ^ state.mouse_previous.buttons;
+    for (u16 button = 0; button < BUTTON_MAX_BUTTONS; button++) {
+        if (changed_buttons & (1 << button)) {
+            ctx.data.u16[0] = button;
+            event_post((state.mouse_current.buttons >> button) & 1 ? EVENT_CODE_BUTTON_PRESSED : EVENT_CODE_BUTTON_RELEASED, 0, ctx);
+        }
+    }
+
+    if (state.mouse_current.delta_x || state.mouse_current.delta_y) {
+        ctx.data.u16[0] = state.mouse_current.x;
+        ctx.data.u16[1] = state.mouse_current.y;
+        event_post(EVENT_CODE_MOUSE_MOVED, 0, ctx);
+    }
+
+    if (state.mouse_current.wheel) {
+        i32 wheel = state.mouse_current.wheel;
+        ctx = (EventContext){0};
+        ctx.data.i8[0] = wheel < -128 ? -128 : wheel > 127 ? 127 : wheel;
+        event_post(EVENT_CODE_MOUSE_WHEEL, 0, ctx);
+    }
+}
+
+b8 input_is_key_down(Keys key) {
+    return initialized && key_bit(&state.keyboard_current, key);
+}
+
+b8 input_was_key_down(Keys key) {
+    return initialized && key_bit(&state.keyboard_previous, key);
+}
+
+b8 input_is_key_pressed(Keys key) {
+    return input_is_key_down(key) && !input_was_key_down(key);
+}
+
+b8 input_is_key_released(Keys key) {
+    return !input_is_key_down(key) && input_was_key_down(key);
+}
+
+b8 input_is_button_down(Buttons button) {
+    return initialized && (state.mouse_current.buttons >> button) & 1;
+}
+
+b8 input_was_button_down(Buttons button) {
+    return initialized && (state.mouse_previous.buttons >> button) & 1;
+}
+
+b8 input_is_button_pressed(Buttons button) {
+    return input_is_button_down(button) && !input_was_button_down(button);
+}
+
+b8 input_is_button_released(Buttons button) {
+    return !input_is_button_down(button) && input_was_button_down(button);
+}
+
+void input_get_mouse_position(i32* x, i32* y) {
+    *x = state.mouse_current.x;
+    *y = state.mouse_current.y;
+}
+
+void input_get_mouse_delta(i32* x, i32* y) {
+    *x = state.mouse_current.delta_x;
+    *y = state.mouse_current.delta_y;
+}
+
+i32 input_get_mouse_wheel() {
+    return state.mouse_current.wheel;
+}
+
+void input_process_key(Keys key, b8 pressed) {
+    if (!initialized || key >= KEY_MAX_KEYS) return;
+
+    u64 bit = 1ull << (key % 64);
+    if (pressed) {
+        state.pending_keyboard.keys[key / 64] |= bit;
+        state.pending_key_taps.keys[key / 64] |= bit;
+    } else {
+        state.pending_keyboard.keys[key / 64] &= ~bit;
+    }
+}
+
+b8 input_is_key_held(Keys key) {
+    return initialized && key_bit(&state.pending_keyboard, key);
+}
+
+void input_process_button(Buttons button, b8 pressed) {
+    if (!initialized || button >= BUTTON_MAX_BUTTONS) return;
+
+    if (pressed) {
+        state.pending_mouse.buttons |= 1 << button;
+        state.pending_button_taps |= 1 << button;
+    } else {
+        state.pending_mouse.buttons &= ~(1 << button);
+    }
+}
+
+void input_process_mouse_move(i32 x, i32 y) {
+    if (!initialized) return;
+
+    state.pending_mouse.delta_x += x - state.pending_mouse.x;
+    state.pending_mouse.delta_y += y - state.pending_mouse.y;
+    state.pending_mouse.x = x;
+    state.pending_mouse.y = y;
+}
+
+void input_process_mouse_enter(i32 x, i32 y) {
+    if (!initialized) return;
+
+    // Jumping to where the pointer entered is not motion.
+    state.pending_mouse.x = x;
+    state.pending_mouse.y = y;
+}
+
+void input_process_mouse_wheel(i32 delta) {
+    if (!initialized) return;
+    state.pending_mouse.wheel += delta;
+}
+
+void input_release_all() {
+    memset(&state.pending_keyboard, 0, sizeof(keyboard_state));
+    memset(&state.pending_key_taps, 0, sizeof(keyboard_state));
+    state.pending_mouse.buttons = 0;
+    state.pending_button_taps = 0;
+}
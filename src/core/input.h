@@ -0,0 +1,176 @@
+#pragma once
+#include "defines.h"
+
+typedef enum Buttons {
+    BUTTON_LEFT,
+    BUTTON_RIGHT,
+    BUTTON_MIDDLE,
+    BUTTON_MAX_BUTTONS
+} Buttons;
+
+// Key codes follow the Windows virtual key values, letters and digits match their ASCII code.
+typedef enum Keys {
+    KEY_BACKSPACE = 0x08,
+    KEY_TAB = 0x09,
+    KEY_ENTER = 0x0D,
+    KEY_SHIFT = 0x10,
+    KEY_CONTROL = 0x11,
+    KEY_ALT = 0x12,
+    KEY_PAUSE = 0x13,
+    KEY_CAPITAL = 0x14,
+    KEY_ESCAPE = 0x1B,
+    KEY_SPACE = 0x20,
+    KEY_PAGEUP = 0x21,
+    KEY_PAGEDOWN = 0x22,
+    KEY_END = 0x23,
+    KEY_HOME = 0x24,
+    KEY_LEFT = 0x25,
+    KEY_UP = 0x26,
+    KEY_RIGHT = 0x27,
+    KEY_DOWN = 0x28,
+    KEY_PRINTSCREEN = 0x2C,
+    KEY_INSERT = 0x2D,
+    KEY_DELETE = 0x2E,
+
+    KEY_0 = 0x30,
+    KEY_1 = 0x31,
+    KEY_2 = 0x32,
+    KEY_3 = 0x33,
+    KEY_4 = 0x34,
+    KEY_5 = 0x35,
+    KEY_6 = 0x36,
+    KEY_7 = 0x37,
+    KEY_8 = 0x38,
+    KEY_9 = 0x39,
+
+    KEY_A = 0x41,
+    KEY_B = 0x42,
+    KEY_C = 0x43,
+    KEY_D = 0x44,
+    KEY_E = 0x45,
+    KEY_F = 0x46,
+    KEY_G = 0x47,
+    KEY_H = 0x48,
+    KEY_I = 0x49,
+    KEY_J = 0x4A,
+    KEY_K = 0x4B,
+    KEY_L = 0x4C,
+    KEY_M = 0x4D,
+    KEY_N = 0x4E,
+    KEY_O = 0x4F,
+    KEY_P = 0x50,
+    KEY_Q = 0x51,
+    KEY_R = 0x52,
+    KEY_S = 0x53,
+    KEY_T = 0x54,
+    KEY_U = 0x55,
+    KEY_V = 0x56,
+    KEY_W = 0x57,
+    KEY_X = 0x58,
+    KEY_Y = 0x59,
+    KEY_Z = 0x5A,
+
+    KEY_LSUPER = 0x5B,
+    KEY_RSUPER = 0x5C,
+
+    KEY_NUMPAD0 = 0x60,
+    KEY_NUMPAD1 = 0x61,
+    KEY_NUMPAD2 = 0x62,
+    KEY_NUMPAD3 = 0x63,
+    KEY_NUMPAD4 = 0x64,
+    KEY_NUMPAD5 = 0x65,
+    KEY_NUMPAD6 = 0x66,
+    KEY_NUMPAD7 = 0x67,
+    KEY_NUMPAD8 = 0x68,
+    KEY_NUMPAD9 = 0x69,
+    KEY_MULTIPLY = 0x6A,
+    KEY_ADD = 0x6B,
+    KEY_SUBTRACT = 0x6D,
+    KEY_DECIMAL = 0x6E,
+    KEY_DIVIDE = 0x6F,
+
+    KEY_F1 = 0x70,
+    KEY_F2 = 0x71,
+    KEY_F3 = 0x72,
+    KEY_F4 = 0x73,
+    KEY_F5 = 0x74,
+    KEY_F6 = 0x75,
+    KEY_F7 = 0x76,
+    KEY_F8 = 0x77,
+    KEY_F9 = 0x78,
+    KEY_F10 = 0x79,
+    KEY_F11 = 0x7A,
+    KEY_F12 = 0x7B,
+
+    KEY_NUMLOCK = 0x90,
+    KEY_SCROLL = 0x91,
+
+    KEY_LSHIFT = 0xA0,
+    KEY_RSHIFT = 0xA1,
+    KEY_LCONTROL = 0xA2,
+    KEY_RCONTROL = 0xA3,
+    KEY_LALT = 0xA4,
+    KEY_RALT = 0xA5,
+
+    KEY_SEMICOLON = 0xBA,
+    KEY_EQUAL = 0xBB,
+    KEY_COMMA = 0xBC,
+    KEY_MINUS = 0xBD,
+    KEY_PERIOD = 0xBE,
+    KEY_SLASH = 0xBF,
+    KEY_GRAVE = 0xC0,
+    KEY_LBRACKET = 0xDB,
+    KEY_BACKSLASH = 0xDC,
+    KEY_RBRACKET = 0xDD,
+    KEY_APOSTROPHE = 0xDE,
+
+    KEY_MAX_KEYS = 0x100
+} Keys;
+
+/*
+ * The platform layer feeds raw input with the input_process_* functions as it arrives. That
+ * only updates a pending state, input_update copies it into the state the rest of the frame
+ * polls, so queries stay stable for a whole frame and a fast mouse costs nothing per event.
+ */
+
+b8 input_initialize();
+void input_shutdown();
+
+/**
+ * Publishes the input gathered since the last call as this frame's state. Called once per
+ * frame after processing the window messages. Keys and buttons that changed also post their
+ * EVENT_CODE_* event, once per change per frame, and pointer motion posts a single
+ * EVENT_CODE_MOUSE_MOVED.
+ */
+void input_update();
+
+// Keyboard
+b8 input_is_key_down(Keys key);
+b8 input_was_key_down(Keys key);
+// Went down this frame.
+b8 input_is_key_pressed(Keys key);
+// Went up this frame.
+b8 input_is_key_released(Keys key);
+
+// Mouse
+b8 input_is_button_down(Buttons button);
+b8 input_was_button_down(Buttons button);
+b8 input_is_button_pressed(Buttons button);
+b8 input_is_button_released(Buttons button);
+void input_get_mouse_position(i32* x, i32* y);
+// Motion accumulated over the frame, in surface pixels.
+void input_get_mouse_delta(i32* x, i32* y);
+// Wheel steps accumulated over the frame, positive is away from the user.
+i32 input_get_mouse_wheel();
+
+// Called by the platform layer.
+void input_process_key(Keys key, b8 pressed);
+// Down in the input gathered since the last input_update, not yet published.
+b8 input_is_key_held(Keys key);
+void input_process_button(Buttons button, b8 pressed);
+void input_process_mouse_move(i32 x, i32 y);
+// The pointer entered the window at this position, without counting it as motion.
+void input_process_mouse_enter(i32 x, i32 y);
+void input_process_mouse_wheel(i32 delta);
+// Releases every key and button, for when the window loses focus.
+void input_release_all();
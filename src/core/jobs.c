@@ -0,0 +1,141 @@
+#include "jobs.h"
+#include "logger.h"
+#include "profiler.h"
+#include "rexmemory.h"
+#include "platform/platform.h"
+
+#include <stdio.h>
+#include <threads.h>
+
+#define JOBS_MAX_THREADS 32
+#define JOBS_INITIAL_CAPACITY 64
+
+typedef struct job_entry {
+    PFN_job job;
+    void* data;
+} job_entry;
+
+typedef struct jobs_state {
+    thrd_t threads[JOBS_MAX_THREADS];
+    u32 thread_count;
+
+    mtx_t mutex;
+    cnd_t has_work;
+    b8 running;
+
+    // Ring buffer, grows when full.
+    job_entry* queue;
+    u32 capacity;
+    u32 head;
+    u32 count;
+} jobs_state;
+
+static jobs_state state;
+
+static i32 worker_thread(void* arg) {
+    char name[32];
+    snprintf(name, sizeof(name), "job worker %u", (u32)(u64)arg);
+    profiler_set_thread_name(name);
+
+    for (;;) {
+        mtx_lock(&state.mutex);
+        while (state.running && state.count == 0) {
+            cnd_wait(&state.has_work, &state.mutex);
+        }
+        if (state.count == 0) {
+            // Only reached once shutdown started and the queue is drained.
+            mtx_unlock(&state.mutex);
+            return 0;
+        }
+
+        job_entry entry = state.queue[state.head];
+        state.head = (state.head + 1) % state.capacity;
+        state.count--;
+        mtx_unlock(&state.mutex);
+
+        ProfileZone zone = profile_zone_begin("job");
+        entry.job(entry.data);
+        profile_zone_end(&zone);
+    }
+}
+
+b8 jobs_initialize(u32 thread_count) {
+    if (thread_count == 0) {
+        u32 processors = platform_get_processor_count();
+        thread_count = processors > 1 ? processors - 1 : 1;
+    }
+    if (thread_count > JOBS_MAX_THREADS) thread_count = JOBS_MAX_THREADS;
+
+    state.capacity = JOBS_INITIAL_CAPACITY;
+    state.queue = rexallocate(sizeof(job_entry) * state.capacity, MEMORY_TAG_JOBS);
+    state.head = 0;
+    state.count = 0;
+    state.running = true;
+    mtx_init(&state.mutex, mtx_plain);
+    cnd_init(&state.has_work);
+
+    for (u32 i = 0; i < thread_count; i++) {
+        if (thrd_create(&state.threads[i], worker_thread, (void*)(u64)i) != thrd_success) {
+            REXERROR("failed to start job thread %i", i);
+            break;
+        }
+        state.thread_count++;
+    }
+
+    if (!state.thread_count) {
+        jobs_shutdown();
+        return false;
+    }
+
+    REXINFO("Job system initialized with %i threads!", state.thread_count);
+    return true;
+}
+
+void jobs_shutdown() {
+    if (!state.queue) return;
+
+    mtx_lock(&state.mutex);
+    state.running = false;
+    cnd_broadcast(&state.has_work);
+    mtx_unlock(&state.mutex);
+
+    for (u32 i = 0; i < state.thread_count; i++) {
+        thrd_join(state.threads[i], 0);
+    }
+    state.thread_count = 0;
+
+    cnd_destroy(&state.has_work);
+    mtx_destroy(&state.mutex);
+    rexfree(state.queue);
+    state.queue = 0;
+}
+
+void jobs_submit(PFN_job job, void* data) {
+    if (!state.thread_count) {
+        // No workers, run it right away.
+        job(data);
+        return;
+    }
+
+    mtx_lock(&state.mutex);
+    if (state.count == state.capacity) {
+        u32 new_capacity = state.capacity * 2;
+        job_entry* new_queue = rexallocate(sizeof(job_entry) * new_capacity, MEMORY_TAG_JOBS);
+        for (u32 i = 0; i < state.count; i++) {
+            new_queue[i] = state.queue[(state.head + i) % state.capacity];
+        }
+        rexfree(state.queue);
+        state.queue = new_queue;
+        state.capacity = new_capacity;
+        state.head = 0;
+    }
+
+    state.queue[(state.head + state.count) % state.capacity] = (job_entry){job, data};
+    state.count++;
+    cnd_signal(&state.has_work);
+    mtx_unlock(&state.mutex);
+}
+
+u32 jobs_thread_count() {
+    return state.thread_count;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "defines.h"
+
+typedef void (*PFN_job)(void* data);
+
+/**
+ * Starts the worker threads.
+ * @param thread_count Number of workers, 0 uses one per processor minus the main thread.
+ */
+b8 jobs_initialize(u32 thread_count);
+
+/**
+ * Finishes every queued job and stops the worker threads.
+ */
+void jobs_shutdown();
+
+/**
+ * Queues a job to run on a worker thread. Jobs start in submission order but may finish in
+ * any order, completion has to be signaled by the job itself.
+ * @param job The function to run.
+ * @param data Passed to the job, must stay valid until the job finishes.
+ */
+void jobs_submit(PFN_job job, void* data);
+
+u32 jobs_thread_count();
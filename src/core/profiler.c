@@ -0,0 +1,243 @@
+#include "profiler.h"
+#include "logger.h"
+#include "rexmemory.h"
+#include "platform/platform.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+// Events are kept in chunks so a thread only pays for what it records.
+#define CHUNK_EVENTS 4096
+// A thread stops recording past this, about 24 MB, and counts what it dropped.
+#define MAX_THREAD_EVENTS (1024 * 1024)
+#define MAX_THREAD_NAME 32
+
+// Track ids in the trace, threads are numbered from 1 in the order they first record.
+#define GPU_TRACK 0
+
+typedef struct profile_event {
+    const char* name;
+    f64 start;
+    f64 end;
+} profile_event;
+
+typedef struct event_chunk {
+    struct event_chunk* next;
+    u32 count;
+    profile_event events[CHUNK_EVENTS];
+} event_chunk;
+
+typedef struct thread_buffer {
+    struct thread_buffer* next;
+    event_chunk* first;
+    event_chunk* last;
+    u64 event_count;
+    u64 dropped;
+    u32 track;
+    char name[MAX_THREAD_NAME];
+} thread_buffer;
+
+typedef struct profiler_state {
+    FILE* file;
+    f64 start_time;
+
+    mtx_t mutex;             // Guards the buffer list, the GPU track and track numbering
+    thread_buffer* buffers;  // Every thread that recorded, freed on shutdown
+    thread_buffer gpu;
+    u32 next_track;
+} profiler_state;
+
+static profiler_state state;
+static _Atomic b8 enabled = false;
+static _Thread_local thread_buffer* local_buffer = 0;
+
+static thread_buffer* register_thread() {
+    thread_buffer* buffer = rexallocate(sizeof(thread_buffer), MEMORY_TAG_PROFILER);
+    memset(buffer, 0, sizeof(thread_buffer));
+
+    mtx_lock(&state.mutex);
+    buffer->track = state.next_track++;
+    snprintf(buffer->name, MAX_THREAD_NAME, "thread %u", buffer->track);
+    buffer->next = state.buffers;
+    state.buffers = buffer;
+    mtx_unlock(&state.mutex);
+
+    local_buffer = buffer;
+    return buffer;
+}
+
+static thread_buffer* current_buffer() {
+    return local_buffer ? local_buffer : register_thread();
+}
+
+static void push_event(thread_buffer* buffer, const char* name, f64 start, f64 end) {
+    if (buffer->event_count >= MAX_THREAD_EVENTS) {
+        buffer->dropped++;
+        return;
+    }
+
+    event_chunk* chunk = buffer->last;
+    if (!chunk || chunk->count == CHUNK_EVENTS) {
+        chunk = rexallocate(sizeof(event_chunk), MEMORY_TAG_PROFILER);
+        chunk->next = 0;
+        chunk->count = 0;
+        if (buffer->last) {
+            buffer->last->next = chunk;
+        } else {
+            buffer->first = chunk;
+        }
+        buffer->last = chunk;
+    }
+
+    chunk->events[chunk->count++] = (profile_event){name, start, end};
+    buffer->event_count++;
+}
+
+static void free_buffer(thread_buffer* buffer) {
+    event_chunk* chunk = buffer->first;
+    while (chunk) {
+        event_chunk* next = chunk->next;
+        rexfree(chunk);
+        chunk = next;
+    }
+    buffer->first = 0;
+    buffer->last = 0;
+}
+
+// Names are plain literals, only quotes and backslashes need escaping.
+static void write_string(const char* string) {
+    fputc('"', state.file);
+    for (const char* c = string; *c; c++) {
+        if (*c == '"' || *c == '\\') fputc('\\', state.file);
+        fputc(*c, state.file);
+    }
+    fputc('"', state.file);
+}
+
+static void write_track(const thread_buffer* buffer, b8* first) {
+    fprintf(state.file, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", *first ? "" : ",",
+            buffer->track);
+    write_string(buffer->name);
+    fprintf(state.file, "}}");
+    *first = false;
+
+    // Microseconds from profiler_initialize, with the sub-microsecond part kept.
+    for (const event_chunk* chunk = buffer->first; chunk; chunk = chunk->next) {
+        for (u32 i = 0; i < chunk->count; i++) {
+            const profile_event* event = &chunk->events[i];
+            fprintf(state.file, ",\n{\"ph\":\"X\",\"name\":");
+            write_string(event->name);
+            fprintf(state.file, ",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", buffer->track,
+                    (event->start - state.start_time) * 1e6, (event->end - event->start) * 1e6);
+        }
+    }
+
+    if (buffer->dropped) {
+        REXWARN("Profiler track [%s] was full, %llu zones dropped", buffer->name, buffer->dropped);
+    }
+}
+
+b8 profiler_initialize(const char* path) {
+    if (!path) return true;
+
+    memset(&state, 0, sizeof(profiler_state));
+    state.file = fopen(path, "w");
+    if (!state.file) {
+        REXERROR("failed to open trace file [%s]!", path);
+        return false;
+    }
+
+    mtx_init(&state.mutex, mtx_plain);
+    state.start_time = platform_get_absolute_time();
+    state.gpu.track = GPU_TRACK;
+    strcpy(state.gpu.name, "GPU");
+    state.next_track = GPU_TRACK + 1;
+
+    atomic_store(&enabled, true);
+    profiler_set_thread_name("main");
+
+    REXINFO("Writing trace to %s", path);
+    return true;
+}
+
+void profiler_shutdown() {
+    if (!atomic_load(&enabled)) return;
+    atomic_store(&enabled, false);
+
+    fprintf(state.file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    b8 first = true;
+    write_track(&state.gpu, &first);
+    for (thread_buffer* buffer = state.buffers; buffer; buffer = buffer->next) {
+        write_track(buffer, &first);
+    }
+    fprintf(state.file, "\n]}\n");
+    fclose(state.file);
+    state.file = 0;
+
+    free_buffer(&state.gpu);
+    thread_buffer* buffer = state.buffers;
+    while (buffer) {
+        thread_buffer* next = buffer->next;
+        free_buffer(buffer);
+        rexfree(buffer);
+        buffer = next;
+    }
+    state.buffers = 0;
+    // The other threads that recorded have exited, only this one still points at its buffer.
+    local_buffer = 0;
+    mtx_destroy(&state.mutex);
+}
+
+b8 profiler_enabled() {
+    return atomic_load_explicit(&enabled, memory_order_relaxed);
+}
+
+void profiler_set_thread_name(const char* name) {
+    if (!profiler_enabled()) return;
+
+    thread_buffer* buffer = current_buffer();
+    mtx_lock(&state.mutex);
+    strncpy(buffer->name, name, MAX_THREAD_NAME - 1);
+    buffer->name[MAX_THREAD_NAME - 1] = 0;
+    mtx_unlock(&state.mutex);
+}
+
+ProfileZone profile_zone_begin(const char* name) {
+    ProfileZone zone = {name, 0};
+    if (profiler_enabled()) zone.start = platform_get_absolute_time();
+    return zone;
+}
+
+void profile_zone_end(ProfileZone* zone) {
+    if (!zone->start) return;
+
+    f64 end = platform_get_absolute_time();
+    if (profiler_enabled()) {
+        push_event(current_buffer(), zone->name, zone->start, end);
+    }
+    zone->start = 0;
+}
+
+void profile_zone_next(ProfileZone* zone, const char* name) {
+    if (!zone->start) {
+        *zone = profile_zone_begin(name);
+        return;
+    }
+
+    f64 now = platform_get_absolute_time();
+    if (profiler_enabled()) {
+        push_event(current_buffer(), zone->name, zone->start, now);
+    }
+    zone->name = name;
+    zone->start = now;
+}
+
+void profiler_gpu_zone(const char* name, f64 start, f64 end) {
+    if (!profiler_enabled()) return;
+
+    mtx_lock(&state.mutex);
+    push_event(&state.gpu, name, start, end);
+    mtx_unlock(&state.mutex);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "defines.h"
+
+/*
+ * Timeline of named zones, written as Chrome trace_event JSON for chrome://tracing or
+ * ui.perfetto.dev. Every thread records into its own buffer, so a zone is two clock reads and
+ * a store with no locking, and nothing at all while profiling is off.
+ *
+ * Zone names are not copied, they must outlive the profiler, string literals or __func__.
+ *
+ *     void create_things() {
+ *         PROFILE_FUNCTION();
+ *         ...
+ *     }
+ *
+ * For consecutive phases of one function, a named zone is moved on with profile_zone_next:
+ *
+ *     PROFILE_SCOPE(zone, "wait");
+ *     ...
+ *     profile_zone_next(&zone, "record");
+ *     ...
+ */
+
+typedef struct ProfileZone {
+    const char* name;
+    f64 start; // 0 if not recording
+} ProfileZone;
+
+/**
+ * @param path File the trace is written to on shutdown. 0 leaves profiling off, every zone
+ * is then a single branch.
+ */
+b8 profiler_initialize(const char* path);
+
+// Writes the trace. Threads that recorded zones must have finished by now.
+void profiler_shutdown();
+
+// TRUE while zones are being recorded.
+b8 profiler_enabled();
+
+/**
+ * Names the calling thread's track in the trace, the main thread is named by
+ * profiler_initialize.
+ * @param name Copied.
+ */
+void profiler_set_thread_name(const char* name);
+
+ProfileZone profile_zone_begin(const char* name);
+void profile_zone_end(ProfileZone* zone);
+
+// Ends the zone and starts the next one at the same time, so phases leave no gaps.
+void profile_zone_next(ProfileZone* zone, const char* name);
+
+/**
+ * Adds a zone to the GPU track.
+ * @param name Zone name.
+ * @param start When the GPU started, in platform_get_absolute_time seconds.
+ * @param end When the GPU finished, same clock.
+ */
+void profiler_gpu_zone(const char* name, f64 start, f64 end);
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+// Zone ending with the enclosing scope, named var so it can be moved on to the next phase.
+#define PROFILE_SCOPE(var, name) ProfileZone var __attribute__((cleanup(profile_zone_end))) = profile_zone_begin(name)
+#define PROFILE_ZONE(name) PROFILE_SCOPE(PROFILE_CONCAT(profile_zone_, __LINE__), name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
@@ -0,0 +1,150 @@
+#include "rexmemory.h"
+#include "logger.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Right before every block. Blocks are at least this aligned so the header is too.
+typedef struct allocation_header {
+    u64 size;
+    u32 tag;
+    u32 offset; // From the start of the malloc'd memory to the block
+} allocation_header;
+
+#define MIN_ALIGNMENT sizeof(allocation_header)
+
+typedef struct memory_tag_counters {
+    _Atomic u64 bytes;
+    _Atomic u64 peak_bytes;
+    _Atomic u64 count;
+    _Atomic u64 total_count;
+} memory_tag_counters;
+
+static memory_tag_counters counters[MEMORY_TAG_MAX_TAGS];
+// Every tag together, its peak is of the sum and not the sum of the peaks.
+static memory_tag_counters total_counters;
+
+static const char* tag_names[MEMORY_TAG_MAX_TAGS] = {
+    "UNKNOWN",
+    "ARRAY",
+    "HASHMAP",
+    "EVENTS",
+    "JOBS",
+    "ARENA",
+    "PLATFORM",
+    "RENDERER",
+    "VULKAN",
+    "PROFILER",
+};
+
+static allocation_header* get_header(void* block) {
+    return (allocation_header*)block - 1;
+}
+
+static void add_allocation(memory_tag_counters* tag_counters, u64 size) {
+    u64 bytes = atomic_fetch_add_explicit(&tag_counters->bytes, size, memory_order_relaxed) + size;
+    atomic_fetch_add_explicit(&tag_counters->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tag_counters->total_count, 1, memory_order_relaxed);
+
+    u64 peak = atomic_load_explicit(&tag_counters->peak_bytes, memory_order_relaxed);
+    while (bytes > peak && !atomic_compare_exchange_weak_explicit(&tag_counters->peak_bytes, &peak, bytes, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static void remove_allocation(memory_tag_counters* tag_counters, u64 size) {
+    atomic_fetch_sub_explicit(&tag_counters->bytes, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&tag_counters->count, 1, memory_order_relaxed);
+}
+
+static void track_allocation(MemoryTag tag, u64 size) {
+    add_allocation(&counters[tag], size);
+    add_allocation(&total_counters, size);
+}
+
+static void track_free(MemoryTag tag, u64 size) {
+    remove_allocation(&counters[tag], size);
+    remove_allocation(&total_counters, size);
+}
+
+static void load_stats(memory_tag_counters* tag_counters, MemoryTagStats* out_stats) {
+    out_stats->bytes = atomic_load_explicit(&tag_counters->bytes, memory_order_relaxed);
+    out_stats->peak_bytes = atomic_load_explicit(&tag_counters->peak_bytes, memory_order_relaxed);
+    out_stats->count = atomic_load_explicit(&tag_counters->count, memory_order_relaxed);
+    out_stats->total_count = atomic_load_explicit(&tag_counters->total_count, memory_order_relaxed);
+}
+
+void* rexallocate(u64 size, MemoryTag tag) {
+    return rexallocate_aligned(size, MIN_ALIGNMENT, tag);
+}
+
+void* rexallocate_aligned(u64 size, u64 alignment, MemoryTag tag) {
+    if (alignment < MIN_ALIGNMENT) alignment = MIN_ALIGNMENT;
+
+    u8* memory = malloc(sizeof(allocation_header) + alignment - 1 + size);
+    if (!memory) return 0;
+
+    u64 start = (u64)(memory + sizeof(allocation_header));
+    u8* block = (u8*)((start + alignment - 1) & ~(alignment - 1));
+
+    allocation_header* header = get_header(block);
+    header->size = size;
+    header->tag = tag;
+    header->offset = (u32)(block - memory);
+
+    track_allocation(tag, size);
+    return block;
+}
+
+void* rexreallocate(void* block, u64 size, u64 alignment) {
+    if (!block) return rexallocate_aligned(size, alignment, MEMORY_TAG_UNKNOWN);
+
+    allocation_header* header = get_header(block);
+    void* new_block = rexallocate_aligned(size, alignment, header->tag);
+    if (!new_block) return 0;
+
+    memcpy(new_block, block, header->size < size ? header->size : size);
+    rexfree(block);
+    return new_block;
+}
+
+void rexfree(void* block) {
+    if (!block) return;
+
+    allocation_header* header = get_header(block);
+    track_free(header->tag, header->size);
+    free((u8*)block - header->offset);
+}
+
+void memory_get_stats(MemoryTag tag, MemoryTagStats* out_stats) {
+    load_stats(&counters[tag], out_stats);
+}
+
+void memory_get_total_stats(MemoryTagStats* out_stats) {
+    load_stats(&total_counters, out_stats);
+}
+
+void memory_log_usage() {
+    REXINFO("Memory usage:      bytes |       peak | allocations |   total");
+    for (u32 tag = 0; tag < MEMORY_TAG_MAX_TAGS; tag++) {
+        MemoryTagStats stats;
+        memory_get_stats(tag, &stats);
+        if (!stats.total_count) continue;
+        REXINFO("  %-9s %10llu | %10llu | %11llu | %7llu", tag_names[tag], stats.bytes, stats.peak_bytes, stats.count, stats.total_count);
+    }
+}
+
+u64 memory_report_leaks() {
+    u64 leaked = 0;
+    for (u32 tag = 0; tag < MEMORY_TAG_MAX_TAGS; tag++) {
+        MemoryTagStats stats;
+        memory_get_stats(tag, &stats);
+        if (!stats.count) continue;
+        REXWARN("Leaked %llu allocations (%llu bytes) tagged %s", stats.count, stats.bytes, tag_names[tag]);
+        leaked += stats.count;
+    }
+    if (!leaked) {
+        REXINFO("No memory leaked");
+    }
+    return leaked;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "defines.h"
+
+// What an allocation is for, statistics are kept per tag.
+typedef enum MemoryTag {
+    MEMORY_TAG_UNKNOWN,
+    MEMORY_TAG_ARRAY,
+    MEMORY_TAG_HASHMAP,
+    MEMORY_TAG_EVENTS,
+    MEMORY_TAG_JOBS,
+    MEMORY_TAG_ARENA,
+    MEMORY_TAG_PLATFORM,
+    MEMORY_TAG_RENDERER,
+    MEMORY_TAG_VULKAN, // Host memory the Vulkan driver allocates through our callbacks
+    MEMORY_TAG_PROFILER,
+
+    MEMORY_TAG_MAX_TAGS
+} MemoryTag;
+
+typedef struct MemoryTagStats {
+    u64 bytes;       // Currently allocated
+    u64 peak_bytes;  // High-water mark of bytes
+    u64 count;       // Live allocations
+    u64 total_count; // Allocations ever made
+} MemoryTagStats;
+
+/*
+ * Every allocation is prefixed with a small header holding its size and tag, so blocks are
+ * freed without passing either back. Safe to call from any thread, the statistics are atomic.
+ */
+
+/**
+ * @param size Size in bytes.
+ * @param tag What the memory is for.
+ * @returns Uninitialized memory aligned for any type, 0 if out of memory.
+ */
+void* rexallocate(u64 size, MemoryTag tag);
+
+/**
+ * @param size Size in bytes.
+ * @param alignment Power of two.
+ * @param tag What the memory is for.
+ * @returns Uninitialized memory, 0 if out of memory.
+ */
+void* rexallocate_aligned(u64 size, u64 alignment, MemoryTag tag);
+
+/**
+ * Resizes a block, keeping its tag and contents up to the smaller of both sizes.
+ * @param block Block from rexallocate*, 0 allocates with MEMORY_TAG_UNKNOWN.
+ * @param size New size in bytes.
+ * @param alignment Power of two.
+ * @returns The new block, 0 if out of memory, in which case the old one is left untouched.
+ */
+void* rexreallocate(void* block, u64 size, u64 alignment);
+
+// Frees a block from rexallocate*, 0 is ignored.
+void rexfree(void* block);
+
+void memory_get_stats(MemoryTag tag, MemoryTagStats* out_stats);
+
+// Statistics of every tag together.
+void memory_get_total_stats(MemoryTagStats* out_stats);
+
+// Logs the statistics of every tag.
+void memory_log_usage();
+
+/**
+ * Logs every tag that still has live allocations, meant for shutdown once everything was
+ * supposed to be freed.
+ * @returns The number of live allocations.
+ */
+u64 memory_report_leaks();
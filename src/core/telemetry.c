@@ -0,0 +1,201 @@
+#include "telemetry.h"
+#include "logger.h"
+#include "platform/platform.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Values are in microseconds. Below SUB_BUCKETS each value has its own bucket, above it every
+// power of two is split into SUB_BUCKETS / 2 buckets, about 1.5% wide at most.
+#define SUB_BUCKET_BITS 7
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define HALF_SUB_BUCKETS (SUB_BUCKETS / 2)
+// Up to 2^40 microseconds, about 12 days.
+#define MAX_SHIFT (40 - SUB_BUCKET_BITS)
+#define BUCKET_COUNT (SUB_BUCKETS + MAX_SHIFT * HALF_SUB_BUCKETS)
+
+typedef struct histogram {
+    u32 counts[BUCKET_COUNT];
+    u64 count;
+    u64 total; // Microseconds
+    u64 max;
+} histogram;
+
+typedef struct telemetry_state {
+    histogram interval[TELEMETRY_METRIC_COUNT];
+    histogram run[TELEMETRY_METRIC_COUNT];
+
+    FILE* file;
+    TelemetryFormat format;
+    f64 export_interval;
+    f64 start_time;
+    f64 interval_start;
+    u64 interval_frames;
+    b8 initialized;
+} telemetry_state;
+
+static telemetry_state state;
+
+static const char* metric_names[TELEMETRY_METRIC_COUNT] = {
+    "cpu_frame",
+    "fence_wait",
+    "acquire",
+    "record",
+    "submit",
+    "gpu",
+};
+
+static u32 bucket_index(u64 value) {
+    if (value < SUB_BUCKETS) return (u32)value;
+
+    u32 shift = (63 - __builtin_clzll(value)) - (SUB_BUCKET_BITS - 1);
+    if (shift > MAX_SHIFT) return BUCKET_COUNT - 1;
+    return SUB_BUCKETS + (shift - 1) * HALF_SUB_BUCKETS + (u32)((value >> shift) - HALF_SUB_BUCKETS);
+}
+
+// Middle of the range of values that land in the bucket.
+static u64 bucket_value(u32 index) {
+    if (index < SUB_BUCKETS) return index;
+
+    u32 shift = (index - SUB_BUCKETS) / HALF_SUB_BUCKETS + 1;
+    u64 sub_bucket = (index - SUB_BUCKETS) % HALF_SUB_BUCKETS + HALF_SUB_BUCKETS;
+    return (sub_bucket << shift) + ((1ull << shift) >> 1);
+}
+
+static void histogram_record(histogram* h, u64 value) {
+    h->counts[bucket_index(value)]++;
+    h->count++;
+    h->total += value;
+    if (value > h->max) h->max = value;
+}
+
+static void histogram_summary(const histogram* h, TelemetrySummary* out_summary) {
+    memset(out_summary, 0, sizeof(TelemetrySummary));
+    if (!h->count) return;
+
+    out_summary->count = h->count;
+    out_summary->mean = (f64)h->total / h->count * 1e-6;
+    out_summary->max = h->max * 1e-6;
+
+    // Value below which the given fraction of the samples are, walking the buckets once.
+    const f64 fractions[3] = {0.50, 0.95, 0.99};
+    f64* outputs[3] = {&out_summary->p50, &out_summary->p95, &out_summary->p99};
+    u32 next = 0;
+    u64 seen = 0;
+    for (u32 i = 0; i < BUCKET_COUNT && next < 3; i++) {
+        seen += h->counts[i];
+        while (next < 3 && seen >= (u64)(fractions[next] * h->count + 0.5) && seen) {
+            u64 value = bucket_value(i);
+            *outputs[next++] = (value > h->max ? h->max : value) * 1e-6;
+        }
+    }
+}
+
+static void export_interval(f64 now) {
+    if (!state.file) return;
+
+    f64 time = now - state.start_time;
+    if (state.format == TELEMETRY_FORMAT_JSON) {
+        fprintf(state.file, "{\"time\":%.3f,\"frames\":%llu", time, state.interval_frames);
+    }
+
+    for (u32 metric = 0; metric < TELEMETRY_METRIC_COUNT; metric++) {
+        TelemetrySummary summary;
+        histogram_summary(&state.interval[metric], &summary);
+        if (!summary.count) continue;
+
+        // Milliseconds in the file, easier to read than seconds.
+        if (state.format == TELEMETRY_FORMAT_JSON) {
+            fprintf(state.file, ",\"%s\":{\"count\":%llu,\"mean\":%.3f,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+                    metric_names[metric], summary.count, summary.mean * 1e3, summary.p50 * 1e3, summary.p95 * 1e3,
+                    summary.p99 * 1e3, summary.max * 1e3);
+        } else {
+            fprintf(state.file, "%.3f,%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f\n", time, metric_names[metric], summary.count,
+                    summary.mean * 1e3, summary.p50 * 1e3, summary.p95 * 1e3, summary.p99 * 1e3, summary.max * 1e3);
+        }
+    }
+
+    if (state.format == TELEMETRY_FORMAT_JSON) {
+        fprintf(state.file, "}\n");
+    }
+    fflush(state.file);
+}
+
+b8 telemetry_initialize(const char* path, TelemetryFormat format, f64 export_interval) {
+    memset(&state, 0, sizeof(telemetry_state));
+    state.format = format;
+    state.export_interval = export_interval;
+    state.start_time = platform_get_absolute_time();
+    state.interval_start = state.start_time;
+
+    if (path) {
+        state.file = fopen(path, "w");
+        if (!state.file) {
+            REXERROR("failed to open telemetry file [%s]!", path);
+            return false;
+        }
+        if (format == TELEMETRY_FORMAT_CSV) {
+            fprintf(state.file, "time,metric,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+        }
+        REXINFO("Writing telemetry to %s", path);
+    }
+
+    state.initialized = true;
+    return true;
+}
+
+void telemetry_shutdown() {
+    if (!state.initialized) return;
+
+    if (state.interval_frames) export_interval(platform_get_absolute_time());
+    if (state.file) fclose(state.file);
+    state.file = 0;
+
+    REXINFO("Frame timings (ms):   count |   mean |    p50 |    p95 |    p99 |    max");
+    for (u32 metric = 0; metric < TELEMETRY_METRIC_COUNT; metric++) {
+        TelemetrySummary summary;
+        histogram_summary(&state.run[metric], &summary);
+        if (!summary.count) continue;
+        REXINFO("  %-10s %10llu | %6.2f | %6.2f | %6.2f | %6.2f | %6.2f", metric_names[metric], summary.count,
+                summary.mean * 1e3, summary.p50 * 1e3, summary.p95 * 1e3, summary.p99 * 1e3, summary.max * 1e3);
+    }
+    state.initialized = false;
+}
+
+void telemetry_record(TelemetryMetric metric, f64 seconds) {
+    if (!state.initialized || seconds < 0) return;
+
+    u64 value = (u64)(seconds * 1e6 + 0.5);
+    histogram_record(&state.interval[metric], value);
+    histogram_record(&state.run[metric], value);
+}
+
+void telemetry_end_frame() {
+    if (!state.initialized) return;
+
+    state.interval_frames++;
+    f64 now = platform_get_absolute_time();
+    if (now - state.interval_start < state.export_interval) return;
+
+    export_interval(now);
+    memset(state.interval, 0, sizeof(state.interval));
+    state.interval_start = now;
+    state.interval_frames = 0;
+}
+
+void telemetry_reset() {
+    if (!state.initialized) return;
+
+    memset(state.interval, 0, sizeof(state.interval));
+    memset(state.run, 0, sizeof(state.run));
+    state.interval_start = platform_get_absolute_time();
+    state.interval_frames = 0;
+}
+
+const char* telemetry_metric_name(TelemetryMetric metric) {
+    return metric_names[metric];
+}
+
+void telemetry_get_summary(TelemetryMetric metric, TelemetrySummary* out_summary) {
+    histogram_summary(&state.run[metric], out_summary);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "defines.h"
+
+typedef enum TelemetryMetric {
+    TELEMETRY_CPU_FRAME,  // From the start of one frame to the start of the next
+    TELEMETRY_FENCE_WAIT, // Blocked on the fence of the frame being reused
+    TELEMETRY_ACQUIRE,    // vkAcquireNextImageKHR
+    TELEMETRY_RECORD,     // Recording the command buffer
+    TELEMETRY_SUBMIT,     // Queue submit and present
+    TELEMETRY_GPU,        // Between the timestamps around the frame's commands
+
+    TELEMETRY_METRIC_COUNT
+} TelemetryMetric;
+
+typedef enum TelemetryFormat {
+    TELEMETRY_FORMAT_JSON, // One object per line and interval
+    TELEMETRY_FORMAT_CSV,  // One row per metric and interval
+} TelemetryFormat;
+
+typedef struct TelemetrySummary {
+    u64 count;
+    f64 mean; // Seconds, like the rest
+    f64 p50;
+    f64 p95;
+    f64 p99;
+    f64 max;
+} TelemetrySummary;
+
+/*
+ * Samples go into log-linear histograms with about 1% resolution from a microsecond to hours,
+ * so recording is a couple of integer operations and percentiles need no sorting. Each metric
+ * has one histogram for the current export interval and one for the whole run.
+ */
+
+/**
+ * @param path File the intervals are written to, truncated. 0 only keeps the run summary.
+ * @param format Layout of the file.
+ * @param export_interval Seconds between two exports.
+ */
+b8 telemetry_initialize(const char* path, TelemetryFormat format, f64 export_interval);
+
+// Exports the last partial interval and logs a summary of the whole run.
+void telemetry_shutdown();
+
+/**
+ * @param metric What was measured.
+ * @param seconds How long it took.
+ */
+void telemetry_record(TelemetryMetric metric, f64 seconds);
+
+// Called once per frame, exports and starts a new interval once it is long enough.
+void telemetry_end_frame();
+
+// Forgets every sample so far, to leave warmup frames out of the run summary.
+void telemetry_reset();
+
+// Name the metric is exported under, like "cpu_frame".
+const char* telemetry_metric_name(TelemetryMetric metric);
+
+/**
+ * @param metric The metric.
+ * @param out_summary Statistics of the whole run so far.
+ */
+void telemetry_get_summary(TelemetryMetric metric, TelemetrySummary* out_summary);
@@ -1,16 +1,29 @@
 #include "defines.h"
 
 #ifdef PLATFORM_WAYLAND
+// memfd_create
+#define _GNU_SOURCE
 #include "platform_wayland.h"
 #include "platform/platform.h"
 #include "core/logger.h"
 #include "core/events.h"
+#include "core/input.h"
+#include "core/rexmemory.h"
 
 #include <wayland-client.h>
+#include <xkbcommon/xkbcommon.h>
+#include <linux/input-event-codes.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 #include "xdg-shell-client-protocol.h"
+#include "presentation-time-client-protocol.h"
+#include "viewporter-client-protocol.h"
+#include "fractional-scale-v1-client-protocol.h"
 
 static void global_registry_handler(void* data, struct wl_registry *registry, u32 id,
 	const char *interface, u32 version);
@@ -42,17 +55,130 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
     .wm_capabilities = wm_capabilities,
 };
 
+static void seat_capabilities(void *data, struct wl_seat *seat, u32 capabilities);
+static void seat_name(void *data, struct wl_seat *seat, const char *name);
+static const struct wl_seat_listener seat_listener = {
+    .capabilities = seat_capabilities,
+    .name = seat_name,
+};
+
+static void keyboard_keymap(void *data, struct wl_keyboard *keyboard, u32 format, i32 fd, u32 size);
+static void keyboard_enter(void *data, struct wl_keyboard *keyboard, u32 serial, struct wl_surface *surface,
+    struct wl_array *keys);
+static void keyboard_leave(void *data, struct wl_keyboard *keyboard, u32 serial, struct wl_surface *surface);
+static void keyboard_key(void *data, struct wl_keyboard *keyboard, u32 serial, u32 time, u32 key, u32 key_state);
+static void keyboard_modifiers(void *data, struct wl_keyboard *keyboard, u32 serial, u32 mods_depressed,
+    u32 mods_latched, u32 mods_locked, u32 group);
+static void keyboard_repeat_info(void *data, struct wl_keyboard *keyboard, i32 rate, i32 delay);
+static const struct wl_keyboard_listener keyboard_listener = {
+    .keymap = keyboard_keymap,
+    .enter = keyboard_enter,
+    .leave = keyboard_leave,
+    .key = keyboard_key,
+    .modifiers = keyboard_modifiers,
+    .repeat_info = keyboard_repeat_info,
+};
+
+static void pointer_enter(void *data, struct wl_pointer *pointer, u32 serial, struct wl_surface *surface,
+    wl_fixed_t x, wl_fixed_t y);
+static void pointer_leave(void *data, struct wl_pointer *pointer, u32 serial, struct wl_surface *surface);
+static void pointer_motion(void *data, struct wl_pointer *pointer, u32 time, wl_fixed_t x, wl_fixed_t y);
+static void pointer_button(void *data, struct wl_pointer *pointer, u32 serial, u32 time, u32 button,
+    u32 button_state);
+static void pointer_axis(void *data, struct wl_pointer *pointer, u32 time, u32 axis, wl_fixed_t value);
+static void pointer_frame(void *data, struct wl_pointer *pointer);
+static void pointer_axis_source(void *data, struct wl_pointer *pointer, u32 axis_source);
+static void pointer_axis_stop(void *data, struct wl_pointer *pointer, u32 time, u32 axis);
+static void pointer_axis_discrete(void *data, struct wl_pointer *pointer, u32 axis, i32 discrete);
+// Bound at version 5 at most, the newer axis events are never sent.
+static const struct wl_pointer_listener pointer_listener = {
+    .enter = pointer_enter,
+    .leave = pointer_leave,
+    .motion = pointer_motion,
+    .button = pointer_button,
+    .axis = pointer_axis,
+    .frame = pointer_frame,
+    .axis_source = pointer_axis_source,
+    .axis_stop = pointer_axis_stop,
+    .axis_discrete = pointer_axis_discrete,
+};
+
+static void presentation_clock_id(void *data, struct wp_presentation *presentation, u32 clock_id);
+static const struct wp_presentation_listener presentation_listener = {
+    .clock_id = presentation_clock_id,
+};
+
+static void feedback_sync_output(void *data, struct wp_presentation_feedback *feedback, struct wl_output *output);
+static void feedback_presented(void *data, struct wp_presentation_feedback *feedback, u32 tv_sec_hi,
+    u32 tv_sec_lo, u32 tv_nsec, u32 refresh, u32 seq_hi, u32 seq_lo, u32 flags);
+static void feedback_discarded(void *data, struct wp_presentation_feedback *feedback);
+static const struct wp_presentation_feedback_listener feedback_listener = {
+    .sync_output = feedback_sync_output,
+    .presented = feedback_presented,
+    .discarded = feedback_discarded,
+};
+
+static void preferred_scale(void *data, struct wp_fractional_scale_v1 *fractional_scale, u32 scale);
+static const struct wp_fractional_scale_v1_listener fractional_scale_listener = {
+    .preferred_scale = preferred_scale,
+};
+
+static void shm_buffer_release(void *data, struct wl_buffer *buffer);
+static const struct wl_buffer_listener shm_buffer_listener = {
+    .release = shm_buffer_release,
+};
+
+static void frame_done(void *data, struct wl_callback *callback, u32 time);
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_done,
+};
+
+// Starting room left for the GPU and the compositor before the vblank, adjusted from feedback.
+#define PACER_INITIAL_MARGIN 0.004
+#define PACER_MIN_MARGIN 0.0005
+#define PACER_MARGIN_STEP 0.001
+#define PACER_MARGIN_DECAY 0.00002
+// While hidden no frame callbacks arrive, keep drawing this often so quitting still works.
+#define PACER_HIDDEN_INTERVAL 0.1
+// Shorter waits are slept instead of polled, poll only has millisecond precision.
+#define PACER_SPIN_THRESHOLD 0.002
+
+#define SEAT_MAX_VERSION 5
+
+// The release requests only exist from version 3, older seats can only drop the proxy.
+static void release_keyboard(struct wl_keyboard* keyboard) {
+    if (wl_keyboard_get_version(keyboard) >= WL_KEYBOARD_RELEASE_SINCE_VERSION) wl_keyboard_release(keyboard);
+    else wl_keyboard_destroy(keyboard);
+}
+
+static void release_pointer(struct wl_pointer* pointer) {
+    if (wl_pointer_get_version(pointer) >= WL_POINTER_RELEASE_SINCE_VERSION) wl_pointer_release(pointer);
+    else wl_pointer_destroy(pointer);
+}
+
+// Scroll distance of one wheel step, in surface pixels.
+#define SCROLL_STEP 10.0
+
 b8 platform_create_window(const char* window_name, u32 pos_x, u32 pos_y, u32 width, u32 height, Window* window) {
-    WaylandState* state = malloc(sizeof(WaylandState));
+    WaylandState* state = rexallocate(sizeof(WaylandState), MEMORY_TAG_PLATFORM);
     memset(state, 0, sizeof(WaylandState));
     window->internal_state = state;
 
+    state->shm_last_buffer = -1;
+    state->scale = 120;
+
+    // Until the compositor tells which clock it uses for presentation timestamps.
+    state->pacer.clock_id = CLOCK_MONOTONIC;
+    state->pacer.margin = PACER_INITIAL_MARGIN;
+
     state->display = wl_display_connect(NULL);
     if (!state->display) {
         REXERROR("Failed to connnect to Wayland display");
         return false;
     }
 
+    state->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+
     state->registry = wl_display_get_registry(state->display);
     wl_registry_add_listener(state->registry, &registry_listener, state);
 
@@ -72,6 +198,20 @@ b8 platform_create_window(const char* window_name, u32 pos_x, u32 pos_y, u32 wid
     state->width = width;
     state->height = height;
 
+    // The viewport sets the window size, whatever the size of the frames presented to it.
+    if (state->viewporter) {
+        state->viewport = wp_viewporter_get_viewport(state->viewporter, state->surface);
+        wp_viewport_set_destination(state->viewport, width, height);
+
+        // Fractional scales only work through a viewport.
+        if (state->fractional_scale_manager) {
+            state->fractional_scale = wp_fractional_scale_manager_v1_get_fractional_scale(state->fractional_scale_manager, state->surface);
+            wp_fractional_scale_v1_add_listener(state->fractional_scale, &fractional_scale_listener, state);
+        }
+    } else {
+        REXINFO("Compositor has no wp_viewporter, rendering at window resolution");
+    }
+
     wl_surface_commit(state->surface);
 
     REXINFO("Wayland state initialized!");
@@ -82,8 +222,36 @@ b8 platform_create_window(const char* window_name, u32 pos_x, u32 pos_y, u32 wid
 void platform_destroy_window(Window* window) {
     WaylandState* state = (WaylandState*)window->internal_state;
 
+    if (state->keyboard) release_keyboard(state->keyboard);
+    if (state->pointer) release_pointer(state->pointer);
+    if (state->seat) {
+        if (wl_seat_get_version(state->seat) >= WL_SEAT_RELEASE_SINCE_VERSION) wl_seat_release(state->seat);
+        else wl_seat_destroy(state->seat);
+    }
+    xkb_state_unref(state->xkb_state);
+    xkb_keymap_unref(state->xkb_keymap);
+    xkb_context_unref(state->xkb_context);
+
+    platform_destroy_software_buffers(window);
+    if (state->shm) wl_shm_destroy(state->shm);
+
+    if (state->fractional_scale) wp_fractional_scale_v1_destroy(state->fractional_scale);
+    if (state->fractional_scale_manager) wp_fractional_scale_manager_v1_destroy(state->fractional_scale_manager);
+    if (state->viewport) wp_viewport_destroy(state->viewport);
+    if (state->viewporter) wp_viewporter_destroy(state->viewporter);
+
+    FramePacer* pacer = &state->pacer;
+    for (u32 i = 0; i < PACER_MAX_PENDING_FEEDBACK; i++) {
+        if (pacer->pending[i].feedback) wp_presentation_feedback_destroy(pacer->pending[i].feedback);
+    }
+    if (pacer->frame_callback) wl_callback_destroy(pacer->frame_callback);
+    if (pacer->presentation) wp_presentation_destroy(pacer->presentation);
+
     wl_surface_destroy(state->surface);
     wl_display_disconnect(state->display);
+
+    rexfree(state);
+    window->internal_state = 0;
 }
 
 b8 platform_show_window(Window* window) {
@@ -96,12 +264,127 @@ b8 platform_hide_window(Window* window) {
     xdg_toplevel_set_minimized(state->xdg_toplevel);
     return true;
 }
+// Dispatches every queued event, waiting up to timeout seconds for the first one.
+static void dispatch_events(WaylandState* state, f64 timeout) {
+    // Events may already be queued, read by the Vulkan driver on the same connection.
+    while (wl_display_prepare_read(state->display) != 0) {
+        wl_display_dispatch_pending(state->display);
+    }
+    wl_display_flush(state->display);
+
+    struct pollfd display_fd = {wl_display_get_fd(state->display), POLLIN, 0};
+    if (poll(&display_fd, 1, (i32)(timeout * 1000.0)) > 0 && (display_fd.revents & POLLIN)) {
+        wl_display_read_events(state->display);
+    } else {
+        wl_display_cancel_read(state->display);
+    }
+    wl_display_dispatch_pending(state->display);
+}
+
+void platform_get_framebuffer_size(Window* window, u32* width, u32* height) {
+    WaylandState* state = (WaylandState*)window->internal_state;
+    // Rounded halfway away from zero, like the compositor does.
+    *width = (state->width * state->scale + 60) / 120;
+    *height = (state->height * state->scale + 60) / 120;
+}
+
+b8 platform_supports_render_scaling(Window* window) {
+    WaylandState* state = (WaylandState*)window->internal_state;
+    return state->viewport != 0;
+}
+
+static void post_resized(WaylandState* state) {
+    // Called from inside wl_display_dispatch, listeners run once the frame dispatches events.
+    EventContext ctx = {0};
+    ctx.data.u16[0] = (state->width * state->scale + 60) / 120;
+    ctx.data.u16[1] = (state->height * state->scale + 60) / 120;
+    event_post(EVENT_CODE_RESIZED, state, ctx);
+}
+
 b8 platform_process_window_messages(Window* window) {
     WaylandState* state = (WaylandState*)window->internal_state;
-    wl_display_dispatch(state->display);
+    dispatch_events(state, 0);
     return true;
 }
 
+static f64 pacer_now(const FramePacer* pacer) {
+    struct timespec now;
+    clock_gettime(pacer->clock_id, &now);
+    return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static void wait_until(WaylandState* state, f64 time) {
+    for (;;) {
+        f64 remaining = time - pacer_now(&state->pacer);
+        if (remaining <= 0) return;
+
+        if (remaining > PACER_SPIN_THRESHOLD) {
+            // Stay responsive to input while waiting, the last stretch is slept precisely.
+            dispatch_events(state, remaining - PACER_SPIN_THRESHOLD * 0.5);
+            continue;
+        }
+
+        struct timespec until;
+        until.tv_sec = (time_t)time;
+        until.tv_nsec = (long)((time - (f64)until.tv_sec) * 1000000000.0);
+        clock_nanosleep(state->pacer.clock_id, TIMER_ABSTIME, &until, 0);
+        return;
+    }
+}
+
+void platform_wait_for_frame(Window* window) {
+    WaylandState* state = (WaylandState*)window->internal_state;
+    FramePacer* pacer = &state->pacer;
+
+    // The compositor answers the frame callback once it wants a new frame, until then anything
+    // drawn would never be shown.
+    f64 wait_start = pacer_now(pacer);
+    while (pacer->frame_callback) {
+        f64 waited = pacer_now(pacer) - wait_start;
+        if (waited >= PACER_HIDDEN_INTERVAL) break;
+        dispatch_events(state, PACER_HIDDEN_INTERVAL - waited);
+    }
+
+    pacer->target = 0;
+    if (pacer->refresh > 0 && pacer->last_presented > 0) {
+        // Start just early enough for the frame to be ready at the first vblank it can make.
+        f64 cost = pacer->cpu_time + pacer->margin;
+        f64 earliest = pacer_now(pacer) + cost;
+        u64 periods = (u64)((earliest - pacer->last_presented) / pacer->refresh) + 1;
+        pacer->target = pacer->last_presented + periods * pacer->refresh;
+        wait_until(state, pacer->target - cost);
+    }
+
+    pacer->frame_start = pacer_now(pacer);
+}
+
+void platform_frame_presenting(Window* window) {
+    WaylandState* state = (WaylandState*)window->internal_state;
+    FramePacer* pacer = &state->pacer;
+
+    // Follow spikes right away, forget them slowly.
+    f64 cpu_time = pacer_now(pacer) - pacer->frame_start;
+    pacer->cpu_time = cpu_time > pacer->cpu_time ? cpu_time : pacer->cpu_time * 0.95 + cpu_time * 0.05;
+
+    // Both requests apply to the commit the Vulkan driver makes while presenting.
+    if (!pacer->frame_callback) {
+        pacer->frame_callback = wl_surface_frame(state->surface);
+        wl_callback_add_listener(pacer->frame_callback, &frame_listener, state);
+    }
+
+    if (!pacer->presentation) return;
+    for (u32 i = 0; i < PACER_MAX_PENDING_FEEDBACK; i++) {
+        PresentFeedback* pending = &pacer->pending[i];
+        if (pending->feedback) continue;
+
+        pending->state = state;
+        pending->target = pacer->target;
+        pending->feedback = wp_presentation_feedback(pacer->presentation, state->surface);
+        wp_presentation_feedback_add_listener(pending->feedback, &feedback_listener, pending);
+        return;
+    }
+}
+
 static void global_registry_handler(void* data, struct wl_registry *registry, u32 id,
 const char *interface, u32 version) {
     
@@ -111,6 +394,20 @@ const char *interface, u32 version) {
     }else if (!strcmp(interface, xdg_wm_base_interface.name)) {
         state->xdg_wm_base = wl_registry_bind(registry, id, &xdg_wm_base_interface, version);
         xdg_wm_base_add_listener(state->xdg_wm_base, &xdg_wm_base_listener, data);
+    }else if (!strcmp(interface, wp_viewporter_interface.name)) {
+        state->viewporter = wl_registry_bind(registry, id, &wp_viewporter_interface, 1);
+    }else if (!strcmp(interface, wp_fractional_scale_manager_v1_interface.name)) {
+        state->fractional_scale_manager = wl_registry_bind(registry, id, &wp_fractional_scale_manager_v1_interface, 1);
+    }else if (!strcmp(interface, wl_shm_interface.name)) {
+        state->shm = wl_registry_bind(registry, id, &wl_shm_interface, 1);
+    }else if (!strcmp(interface, wp_presentation_interface.name)) {
+        state->pacer.presentation = wl_registry_bind(registry, id, &wp_presentation_interface, 1);
+        wp_presentation_add_listener(state->pacer.presentation, &presentation_listener, data);
+    }else if (!strcmp(interface, wl_seat_interface.name) && !state->seat) {
+        // Only the first seat drives input.
+        u32 bind_version = version < SEAT_MAX_VERSION ? version : SEAT_MAX_VERSION;
+        state->seat = wl_registry_bind(registry, id, &wl_seat_interface, bind_version);
+        wl_seat_add_listener(state->seat, &seat_listener, data);
     }
 }
 
@@ -120,7 +417,10 @@ static void xdg_wm_base_ping(void *data, struct xdg_wm_base *shell, u32 serial)
     xdg_wm_base_pong(shell, serial);
 }
 
-static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u32 serial) {}
+static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u32 serial) {
+    // The toplevel size came before, it applies with the next commit.
+    xdg_surface_ack_configure(xdg_surface, serial);
+}
 
 static void xdg_toplevel_configure (void *data, struct xdg_toplevel *xdg_toplevel, i32 width, 
     i32 height, struct wl_array *states) {
@@ -130,10 +430,20 @@ static void xdg_toplevel_configure (void *data, struct xdg_toplevel *xdg_topleve
     if (!width || !height) return;
 	if (width == state->width && height == state->height) return;
 
-    EventContext ctx = {0};
-    ctx.data.u16[0] = width;
-    ctx.data.u16[1] = height;
-    event_fire(EVENT_CODE_RESIZED, state, ctx);
+    state->width = width;
+    state->height = height;
+    if (state->viewport) wp_viewport_set_destination(state->viewport, width, height);
+
+    post_resized(state);
+}
+
+static void preferred_scale(void *data, struct wp_fractional_scale_v1 *fractional_scale, u32 scale) {
+    WaylandState* state = (WaylandState*)data;
+    if (scale == state->scale) return;
+
+    REXINFO("Window scale is %.2f", scale / 120.0);
+    state->scale = scale;
+    post_resized(state);
 }
 
 void xgd_toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel) {
@@ -144,6 +454,397 @@ void xgd_toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel) {
 void configure_bounds(void *data, struct xdg_toplevel *xdg_toplevel, i32 width, i32 height) {}
 void wm_capabilities(void *data, struct xdg_toplevel *xdg_toplevel, struct wl_array *capabilities) {}
 
+b8 platform_create_software_buffers(Window* window, u32 width, u32 height, u32 buffer_count) {
+    WaylandState* state = (WaylandState*)window->internal_state;
+
+    if (!state->shm) {
+        REXERROR("Compositor has no wl_shm, software presentation unavailable");
+        return false;
+    }
+    if (buffer_count > SHM_MAX_BUFFERS) buffer_count = SHM_MAX_BUFFERS;
+
+    state->shm_width = width;
+    state->shm_height = height;
+    state->shm_stride = width * 4;
+    state->shm_size = (u64)state->shm_stride * height * buffer_count;
+
+    i32 fd = memfd_create("triangle-shm", MFD_CLOEXEC);
+    if (fd < 0) {
+        REXERROR("Failed to create the shared memory file");
+        return false;
+    }
+    if (ftruncate(fd, state->shm_size) < 0) {
+        REXERROR("Failed to size the shared memory file");
+        close(fd);
+        return false;
+    }
+
+    state->shm_data = mmap(0, state->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (state->shm_data == MAP_FAILED) {
+        REXERROR("Failed to map the shared memory file");
+        state->shm_data = 0;
+        close(fd);
+        return false;
+    }
+
+    // The pool keeps its own reference to the file.
+    struct wl_shm_pool* pool = wl_shm_create_pool(state->shm, fd, state->shm_size);
+    for (u32 i = 0; i < buffer_count; i++) {
+        ShmBuffer* buffer = &state->shm_buffers[i];
+        u32 offset = state->shm_stride * height * i;
+        buffer->buffer = wl_shm_pool_create_buffer(pool, offset, width, height, state->shm_stride, WL_SHM_FORMAT_XRGB8888);
+        buffer->pixels = state->shm_data + offset;
+        buffer->busy = false;
+        wl_buffer_add_listener(buffer->buffer, &shm_buffer_listener, buffer);
+    }
+    wl_shm_pool_destroy(pool);
+    close(fd);
+
+    state->shm_buffer_count = buffer_count;
+    state->shm_last_buffer = -1;
+
+    REXINFO("Presenting through %i shared memory buffers", buffer_count);
+    return true;
+}
+
+void platform_destroy_software_buffers(Window* window) {
+    WaylandState* state = (WaylandState*)window->internal_state;
+    if (!state->shm_data) return;
+
+    for (u32 i = 0; i < state->shm_buffer_count; i++) {
+        wl_buffer_destroy(state->shm_buffers[i].buffer);
+    }
+    munmap(state->shm_data, state->shm_size);
+    memset(state->shm_buffers, 0, sizeof(state->shm_buffers));
+    state->shm_data = 0;
+    state->shm_buffer_count = 0;
+    state->shm_last_buffer = -1;
+}
+
+b8 platform_present_software_frame(Window* window, const void* pixels, u32 row_pitch) {
+    WaylandState* state = (WaylandState*)window->internal_state;
+
+    // Compositors often release a buffer right after uploading it, the one on screen is only
+    // written to again when no other buffer is free.
+    i32 free_buffer = -1;
+    for (u32 i = 0; i < state->shm_buffer_count; i++) {
+        if (state->shm_buffers[i].busy) continue;
+        free_buffer = i;
+        if (free_buffer != state->shm_last_buffer) break;
+    }
+    if (free_buffer < 0) return false;
+
+    ShmBuffer* buffer = &state->shm_buffers[free_buffer];
+    const u8* previous = state->shm_last_buffer >= 0 ? state->shm_buffers[state->shm_last_buffer].pixels : 0;
+
+    // Rows matching the frame on screen don't need to be damaged. Compared before the copy, the
+    // previous frame may be in the buffer written to.
+    i32 first_changed = -1;
+    i32 last_changed = -1;
+    u32 row_size = state->shm_width * 4;
+    for (u32 y = 0; y < state->shm_height; y++) {
+        const u8* source = (const u8*)pixels + (u64)row_pitch * y;
+        u8* destination = buffer->pixels + (u64)state->shm_stride * y;
+
+        if (!previous || memcmp(source, previous + (u64)state->shm_stride * y, row_size)) {
+            if (first_changed < 0) first_changed = y;
+            last_changed = y;
+        }
+        memcpy(destination, source, row_size);
+    }
+
+    if (first_changed < 0) {
+        // Same picture, commit anyway so the frame callback is delivered.
+        wl_surface_commit(state->surface);
+        return true;
+    }
+
+    wl_surface_attach(state->surface, buffer->buffer, 0, 0);
+    if (wl_surface_get_version(state->surface) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+        wl_surface_damage_buffer(state->surface, 0, first_changed, state->shm_width, last_changed - first_changed + 1);
+    } else {
+        wl_surface_damage(state->surface, 0, first_changed, state->shm_width, last_changed - first_changed + 1);
+    }
+    wl_surface_commit(state->surface);
+
+    buffer->busy = true;
+    state->shm_last_buffer = free_buffer;
+    return true;
+}
+
+static void shm_buffer_release(void *data, struct wl_buffer *wl_buffer) {
+    ShmBuffer* buffer = (ShmBuffer*)data;
+    buffer->busy = false;
+}
+
+static void presentation_clock_id(void *data, struct wp_presentation *presentation, u32 clock_id) {
+    WaylandState* state = (WaylandState*)data;
+    state->pacer.clock_id = clock_id;
+}
+
+static void frame_done(void *data, struct wl_callback *callback, u32 time) {
+    WaylandState* state = (WaylandState*)data;
+    wl_callback_destroy(callback);
+    state->pacer.frame_callback = 0;
+}
+
+static void feedback_sync_output(void *data, struct wp_presentation_feedback *feedback, struct wl_output *output) {}
+
+static void feedback_presented(void *data, struct wp_presentation_feedback *feedback, u32 tv_sec_hi,
+    u32 tv_sec_lo, u32 tv_nsec, u32 refresh, u32 seq_hi, u32 seq_lo, u32 flags) {
+
+    PresentFeedback* pending = (PresentFeedback*)data;
+    FramePacer* pacer = &pending->state->pacer;
+
+    f64 presented = (f64)(((u64)tv_sec_hi << 32) | tv_sec_lo) + tv_nsec * 0.000000001;
+    if ((flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC) && refresh) {
+        pacer->refresh = refresh * 0.000000001;
+        pacer->last_presented = presented;
+
+        // Landing a refresh late means the GPU or the compositor needed more time than we left.
+        if (pending->target > 0) {
+            if (presented > pending->target + pacer->refresh * 0.5) {
+                pacer->margin += PACER_MARGIN_STEP;
+                if (pacer->margin > pacer->refresh * 0.75) pacer->margin = pacer->refresh * 0.75;
+            } else if (pacer->margin > PACER_MIN_MARGIN) {
+                pacer->margin -= PACER_MARGIN_DECAY;
+            }
+        }
+    }
+
+    wp_presentation_feedback_destroy(feedback);
+    pending->feedback = 0;
+}
+
+static void feedback_discarded(void *data, struct wp_presentation_feedback *feedback) {
+    PresentFeedback* pending = (PresentFeedback*)data;
+    wp_presentation_feedback_destroy(feedback);
+    pending->feedback = 0;
+}
+
+static void seat_capabilities(void *data, struct wl_seat *seat, u32 capabilities) {
+    WaylandState* state = (WaylandState*)data;
+
+    b8 has_keyboard = (capabilities & WL_SEAT_CAPABILITY_KEYBOARD) != 0;
+    if (has_keyboard && !state->keyboard) {
+        state->keyboard = wl_seat_get_keyboard(seat);
+        wl_keyboard_add_listener(state->keyboard, &keyboard_listener, data);
+    } else if (!has_keyboard && state->keyboard) {
+        release_keyboard(state->keyboard);
+        state->keyboard = 0;
+        input_release_all();
+    }
+
+    b8 has_pointer = (capabilities & WL_SEAT_CAPABILITY_POINTER) != 0;
+    if (has_pointer && !state->pointer) {
+        state->pointer = wl_seat_get_pointer(seat);
+        wl_pointer_add_listener(state->pointer, &pointer_listener, data);
+    } else if (!has_pointer && state->pointer) {
+        release_pointer(state->pointer);
+        state->pointer = 0;
+    }
+}
+
+static void seat_name(void *data, struct wl_seat *seat, const char *name) {}
+
+static void keyboard_keymap(void *data, struct wl_keyboard *keyboard, u32 format, i32 fd, u32 size) {
+    WaylandState* state = (WaylandState*)data;
+
+    if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
+        REXWARN("Unsupported keymap format %u, keyboard input disabled", format);
+        close(fd);
+        return;
+    }
+
+    char* keymap_string = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (keymap_string == MAP_FAILED) {
+        REXERROR("Failed to map the keymap");
+        return;
+    }
+
+    struct xkb_keymap* keymap = xkb_keymap_new_from_string(state->xkb_context, keymap_string,
+        XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    munmap(keymap_string, size);
+    if (!keymap) {
+        REXERROR("Failed to compile the keymap");
+        return;
+    }
+
+    xkb_state_unref(state->xkb_state);
+    xkb_keymap_unref(state->xkb_keymap);
+    state->xkb_keymap = keymap;
+    state->xkb_state = xkb_state_new(keymap);
+}
+
+static Keys translate_keysym(xkb_keysym_t sym) {
+    if (sym >= XKB_KEY_a && sym <= XKB_KEY_z) return KEY_A + (sym - XKB_KEY_a);
+    if (sym >= XKB_KEY_A && sym <= XKB_KEY_Z) return KEY_A + (sym - XKB_KEY_A);
+    if (sym >= XKB_KEY_0 && sym <= XKB_KEY_9) return KEY_0 + (sym - XKB_KEY_0);
+    if (sym >= XKB_KEY_F1 && sym <= XKB_KEY_F12) return KEY_F1 + (sym - XKB_KEY_F1);
+    if (sym >= XKB_KEY_KP_0 && sym <= XKB_KEY_KP_9) return KEY_NUMPAD0 + (sym - XKB_KEY_KP_0);
+
+    switch (sym) {
+        case XKB_KEY_BackSpace: return KEY_BACKSPACE;
+        case XKB_KEY_Tab: return KEY_TAB;
+        case XKB_KEY_Return: return KEY_ENTER;
+        case XKB_KEY_KP_Enter: return KEY_ENTER;
+        case XKB_KEY_Pause: return KEY_PAUSE;
+        case XKB_KEY_Caps_Lock: return KEY_CAPITAL;
+        case XKB_KEY_Escape: return KEY_ESCAPE;
+        case XKB_KEY_space: return KEY_SPACE;
+        case XKB_KEY_Page_Up: return KEY_PAGEUP;
+        case XKB_KEY_Page_Down: return KEY_PAGEDOWN;
+        case XKB_KEY_End: return KEY_END;
+        case XKB_KEY_Home: return KEY_HOME;
+        case XKB_KEY_Left: return KEY_LEFT;
+        case XKB_KEY_Up: return KEY_UP;
+        case XKB_KEY_Right: return KEY_RIGHT;
+        case XKB_KEY_Down: return KEY_DOWN;
+        case XKB_KEY_Print: return KEY_PRINTSCREEN;
+        case XKB_KEY_Insert: return KEY_INSERT;
+        case XKB_KEY_Delete: return KEY_DELETE;
+        case XKB_KEY_Super_L: return KEY_LSUPER;
+        case XKB_KEY_Super_R: return KEY_RSUPER;
+        case XKB_KEY_KP_Multiply: return KEY_MULTIPLY;
+        case XKB_KEY_KP_Add: return KEY_ADD;
+        case XKB_KEY_KP_Subtract: return KEY_SUBTRACT;
+        case XKB_KEY_KP_Decimal: return KEY_DECIMAL;
+        case XKB_KEY_KP_Divide: return KEY_DIVIDE;
+        case XKB_KEY_Num_Lock: return KEY_NUMLOCK;
+        case XKB_KEY_Scroll_Lock: return KEY_SCROLL;
+        case XKB_KEY_Shift_L: return KEY_LSHIFT;
+        case XKB_KEY_Shift_R: return KEY_RSHIFT;
+        case XKB_KEY_Control_L: return KEY_LCONTROL;
+        case XKB_KEY_Control_R: return KEY_RCONTROL;
+        case XKB_KEY_Alt_L: return KEY_LALT;
+        case XKB_KEY_Alt_R: return KEY_RALT;
+        case XKB_KEY_semicolon: return KEY_SEMICOLON;
+        case XKB_KEY_equal: return KEY_EQUAL;
+        case XKB_KEY_comma: return KEY_COMMA;
+        case XKB_KEY_minus: return KEY_MINUS;
+        case XKB_KEY_period: return KEY_PERIOD;
+        case XKB_KEY_slash: return KEY_SLASH;
+        case XKB_KEY_grave: return KEY_GRAVE;
+        case XKB_KEY_bracketleft: return KEY_LBRACKET;
+        case XKB_KEY_backslash: return KEY_BACKSLASH;
+        case XKB_KEY_bracketright: return KEY_RBRACKET;
+        case XKB_KEY_apostrophe: return KEY_APOSTROPHE;
+        default: return KEY_MAX_KEYS;
+    }
+}
+
+static void process_key(WaylandState* state, u32 key, b8 pressed) {
+    if (!state->xkb_state) return;
+
+    // Evdev codes are offset by 8 in xkb. The unshifted symbol of the active layout is used so
+    // a key releases the same code it pressed, whatever the modifiers did in between.
+    xkb_keycode_t keycode = key + 8;
+    xkb_layout_index_t layout = xkb_state_key_get_layout(state->xkb_state, keycode);
+    const xkb_keysym_t* syms;
+    if (xkb_keymap_key_get_syms_by_level(state->xkb_keymap, keycode, layout, 0, &syms) < 1) return;
+
+    Keys translated = translate_keysym(syms[0]);
+    input_process_key(translated, pressed);
+
+    // Also drive the side agnostic modifier codes, down while either side is.
+    if (translated == KEY_LSHIFT || translated == KEY_RSHIFT) {
+        input_process_key(KEY_SHIFT, input_is_key_held(KEY_LSHIFT) || input_is_key_held(KEY_RSHIFT));
+    }
+    if (translated == KEY_LCONTROL || translated == KEY_RCONTROL) {
+        input_process_key(KEY_CONTROL, input_is_key_held(KEY_LCONTROL) || input_is_key_held(KEY_RCONTROL));
+    }
+    if (translated == KEY_LALT || translated == KEY_RALT) {
+        input_process_key(KEY_ALT, input_is_key_held(KEY_LALT) || input_is_key_held(KEY_RALT));
+    }
+}
+
+static void keyboard_enter(void *data, struct wl_keyboard *keyboard, u32 serial, struct wl_surface *surface,
+    struct wl_array *keys) {
+
+    WaylandState* state = (WaylandState*)data;
+    u32* key;
+    wl_array_for_each(key, keys) {
+        process_key(state, *key, true);
+    }
+}
+
+static void keyboard_leave(void *data, struct wl_keyboard *keyboard, u32 serial, struct wl_surface *surface) {
+    // No release events arrive once focus is gone.
+    input_release_all();
+}
+
+static void keyboard_key(void *data, struct wl_keyboard *keyboard, u32 serial, u32 time, u32 key, u32 key_state) {
+    process_key((WaylandState*)data, key, key_state == WL_KEYBOARD_KEY_STATE_PRESSED);
+}
+
+static void keyboard_modifiers(void *data, struct wl_keyboard *keyboard, u32 serial, u32 mods_depressed,
+    u32 mods_latched, u32 mods_locked, u32 group) {
+
+    WaylandState* state = (WaylandState*)data;
+    if (!state->xkb_state) return;
+    xkb_state_update_mask(state->xkb_state, mods_depressed, mods_latched, mods_locked, 0, 0, group);
+}
+
+static void keyboard_repeat_info(void *data, struct wl_keyboard *keyboard, i32 rate, i32 delay) {}
+
+static void pointer_enter(void *data, struct wl_pointer *pointer, u32 serial, struct wl_surface *surface,
+    wl_fixed_t x, wl_fixed_t y) {
+
+    input_process_mouse_enter(wl_fixed_to_int(x), wl_fixed_to_int(y));
+}
+
+static void pointer_leave(void *data, struct wl_pointer *pointer, u32 serial, struct wl_surface *surface) {}
+
+static void pointer_motion(void *data, struct wl_pointer *pointer, u32 time, wl_fixed_t x, wl_fixed_t y) {
+    input_process_mouse_move(wl_fixed_to_int(x), wl_fixed_to_int(y));
+}
+
+static void pointer_button(void *data, struct wl_pointer *pointer, u32 serial, u32 time, u32 button,
+    u32 button_state) {
+
+    b8 pressed = button_state == WL_POINTER_BUTTON_STATE_PRESSED;
+    switch (button) {
+        case BTN_LEFT: input_process_button(BUTTON_LEFT, pressed); break;
+        case BTN_RIGHT: input_process_button(BUTTON_RIGHT, pressed); break;
+        case BTN_MIDDLE: input_process_button(BUTTON_MIDDLE, pressed); break;
+    }
+}
+
+static void pointer_axis(void *data, struct wl_pointer *pointer, u32 time, u32 axis, wl_fixed_t value) {
+    WaylandState* state = (WaylandState*)data;
+    if (axis != WL_POINTER_AXIS_VERTICAL_SCROLL || state->scroll_discrete_in_frame) return;
+
+    // Positive values scroll down, wheel steps are positive away from the user.
+    state->scroll_remainder -= wl_fixed_to_double(value);
+    i32 steps = (i32)(state->scroll_remainder / SCROLL_STEP);
+    if (steps) {
+        state->scroll_remainder -= steps * SCROLL_STEP;
+        input_process_mouse_wheel(steps);
+    }
+}
+
+static void pointer_frame(void *data, struct wl_pointer *pointer) {
+    WaylandState* state = (WaylandState*)data;
+    state->scroll_discrete_in_frame = false;
+}
+
+static void pointer_axis_source(void *data, struct wl_pointer *pointer, u32 axis_source) {}
+
+static void pointer_axis_stop(void *data, struct wl_pointer *pointer, u32 time, u32 axis) {
+    WaylandState* state = (WaylandState*)data;
+    if (axis == WL_POINTER_AXIS_VERTICAL_SCROLL) state->scroll_remainder = 0;
+}
+
+static void pointer_axis_discrete(void *data, struct wl_pointer *pointer, u32 axis, i32 discrete) {
+    WaylandState* state = (WaylandState*)data;
+    if (axis != WL_POINTER_AXIS_VERTICAL_SCROLL) return;
+
+    // Sent before the matching axis event, which is then skipped.
+    state->scroll_discrete_in_frame = true;
+    input_process_mouse_wheel(-discrete);
+}
+
 void platform_console_write(const char* message, u8 colour) {
     // FATAL,ERROR,WARN,INFO,DEBUG,TRACE
     const char* colour_strings[] = {"0;41", "1;31", "1;33", "1;32", "1;34", "1;30"};
@@ -156,4 +857,19 @@ void platform_console_write_error(const char* message, u8 colour) {
     printf("\033[%sm%s\033[0m", colour_strings[colour], message);
 }
 
+f64 platform_get_absolute_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+f64 platform_clock_to_seconds(u64 timestamp) {
+    return timestamp * 0.000000001;
+}
+
+u32 platform_get_processor_count() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
 #endif
\ No newline at end of file
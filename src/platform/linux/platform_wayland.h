@@ -1,6 +1,41 @@
 #pragma once
 #include "defines.h"
 
+// Frames presented but not reported back yet, see platform_frame_presenting.
+#define PACER_MAX_PENDING_FEEDBACK 4
+
+typedef struct PresentFeedback {
+    struct WaylandState* state;
+    struct wp_presentation_feedback* feedback;
+    f64 target; // vblank the frame was paced for, 0 when unknown
+} PresentFeedback;
+
+// Timings are in seconds on the presentation clock.
+typedef struct FramePacer {
+    struct wp_presentation* presentation;
+    u32 clock_id;
+
+    // Requested with the last presented frame, the compositor is ready for another one once done.
+    struct wl_callback* frame_callback;
+
+    PresentFeedback pending[PACER_MAX_PENDING_FEEDBACK];
+
+    f64 last_presented; // 0 until the compositor reported a vsynced presentation
+    f64 refresh;        // 0 when unknown
+    f64 frame_start;
+    f64 target;         // vblank the current frame is paced for
+    f64 cpu_time;       // from frame start to present, decays slowly after a spike
+    f64 margin;         // extra room for the GPU and the compositor latch, grows on misses
+} FramePacer;
+
+#define SHM_MAX_BUFFERS 3
+
+typedef struct ShmBuffer {
+    struct wl_buffer* buffer;
+    u8* pixels;
+    b8 busy; // attached, until the compositor releases it
+} ShmBuffer;
+
 typedef struct WaylandState {
     struct wl_display* display;
     struct wl_registry* registry;
@@ -10,6 +45,38 @@ typedef struct WaylandState {
     struct xdg_wm_base *xdg_wm_base;
     struct xdg_surface* xdg_surface;
     struct xdg_toplevel* xdg_toplevel;
+
+    struct wl_seat* seat;
+    struct wl_keyboard* keyboard;
+    struct wl_pointer* pointer;
+
+    struct xkb_context* xkb_context;
+    struct xkb_keymap* xkb_keymap;
+    struct xkb_state* xkb_state;
+
+    // Continuous scroll (touchpads) not yet turned into wheel steps.
+    f64 scroll_remainder;
+    b8 scroll_discrete_in_frame;
+
+    FramePacer pacer;
+
+    // Scales frames to the window size, see platform_supports_render_scaling.
+    struct wp_viewporter* viewporter;
+    struct wp_viewport* viewport;
+    struct wp_fractional_scale_manager_v1* fractional_scale_manager;
+    struct wp_fractional_scale_v1* fractional_scale;
+    u32 scale; // preferred scale in 120ths, 120 is 1.0
+
+    // Software presentation, all buffers share one memfd mapping.
+    struct wl_shm* shm;
+    ShmBuffer shm_buffers[SHM_MAX_BUFFERS];
+    u32 shm_buffer_count;
+    u8* shm_data;
+    u64 shm_size;
+    u32 shm_width;
+    u32 shm_height;
+    u32 shm_stride;
+    i32 shm_last_buffer; // last buffer shown, -1 if none
     
     u32 width;
     u32 height;
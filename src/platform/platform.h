@@ -12,5 +12,64 @@ b8 platform_show_window(Window* window);
 b8 platform_hide_window(Window* window);
 b8 platform_process_window_messages(Window* window);
 
+/**
+ * Size of the window in pixels, what a frame rendered at full resolution should be. With
+ * fractional scaling this is the window size times the scale.
+ */
+void platform_get_framebuffer_size(Window* window, u32* width, u32* height);
+
+/**
+ * Presented frames smaller than the framebuffer size are scaled up to fill the window, so the
+ * renderer can lower its resolution. Without it frames must match the framebuffer size.
+ */
+b8 platform_supports_render_scaling(Window* window);
+
+/**
+ * Frame pacing. Blocks until the next frame should start, as late as possible while still
+ * making the compositor's next refresh, and stops rendering while the window is not shown.
+ * Window messages keep being processed while waiting. Returns right away on platforms
+ * without pacing.
+ */
+void platform_wait_for_frame(Window* window);
+
+/**
+ * Call right before presenting a frame, so its presentation is tracked by the pacer.
+ */
+void platform_frame_presenting(Window* window);
+
+/**
+ * Software presentation, for when the GPU can't present to the window itself. Creates
+ * buffer_count shared memory buffers the window shows frames from.
+ * @param width Frame width in pixels.
+ * @param height Frame height in pixels.
+ * @param buffer_count Number of buffers, one is held by the compositor while another is filled.
+ * @returns FALSE if the platform has no software presentation.
+ */
+b8 platform_create_software_buffers(Window* window, u32 width, u32 height, u32 buffer_count);
+void platform_destroy_software_buffers(Window* window);
+
+/**
+ * Copies a frame into a free buffer and shows it, only the rows that changed since the
+ * previous frame are damaged.
+ * @param pixels 32-bit pixels, blue green red and one unused byte.
+ * @param row_pitch Bytes between the start of two rows.
+ * @returns FALSE if every buffer is still in use by the compositor, the frame is not shown.
+ */
+b8 platform_present_software_frame(Window* window, const void* pixels, u32 row_pitch);
+
 void platform_console_write(const char* message, u8 colour);
-void platform_console_write_error(const char* message, u8 colour);
\ No newline at end of file
+void platform_console_write_error(const char* message, u8 colour);
+
+/**
+ * Monotonic time in seconds, only meaningful relative to another call.
+ */
+f64 platform_get_absolute_time();
+
+/**
+ * For timestamps taken by something else from the clock platform_get_absolute_time reads,
+ * CLOCK_MONOTONIC on Linux and QueryPerformanceCounter on Windows.
+ * @param timestamp Raw clock value, nanoseconds or performance counter ticks.
+ * @returns The same time as platform_get_absolute_time would have returned it.
+ */
+f64 platform_clock_to_seconds(u64 timestamp);
+u32 platform_get_processor_count();
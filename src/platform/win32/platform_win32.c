@@ -5,6 +5,8 @@
 #include "platform_win32.h"
 #include "PLATFORM/platform.h"
 #include "core/events.h"
+#include "core/input.h"
+#include "core/rexmemory.h"
 #include <windows.h>
 #include <windowsx.h>
 #include <stdlib.h>
@@ -12,7 +14,7 @@
 LRESULT CALLBACK win32_process_message(HWND hwnd, u32 msg, WPARAM w_param, LPARAM l_param);
 
 b8 platform_create_window(const char* window_name, u32 pos_x, u32 pos_y, u32 width, u32 height, Window* window) {
-    Win32State* state = malloc(sizeof(Win32State));
+    Win32State* state = rexallocate(sizeof(Win32State), MEMORY_TAG_PLATFORM);
     memset(state, 0, sizeof(Win32State));
     window->internal_state = state;
 
@@ -80,6 +82,9 @@ void platform_destroy_window(Window* window) {
     Win32State* state = window->internal_state;
     DestroyWindow(state->hwnd);
     UnregisterClassA("triangle_window_class", state->h_instance);
+
+    rexfree(state);
+    window->internal_state = 0;
 }
 
 b8 platform_show_window(Window* window) {
@@ -103,6 +108,29 @@ b8 platform_process_window_messages(Window* window) {
     return true;
 }
 
+void platform_get_framebuffer_size(Window* window, u32* width, u32* height) {
+    Win32State* state = (Win32State*)window->internal_state;
+    RECT r;
+    GetClientRect(state->hwnd, &r);
+    *width = r.right - r.left;
+    *height = r.bottom - r.top;
+}
+
+b8 platform_supports_render_scaling(Window* window) {
+    return false;
+}
+
+void platform_wait_for_frame(Window* window) {}
+void platform_frame_presenting(Window* window) {}
+
+b8 platform_create_software_buffers(Window* window, u32 width, u32 height, u32 buffer_count) {
+    return false;
+}
+void platform_destroy_software_buffers(Window* window) {}
+b8 platform_present_software_frame(Window* window, const void* pixels, u32 row_pitch) {
+    return false;
+}
+
 void platform_console_write(const char* message, u8 colour) {
     HANDLE console_handle = GetStdHandle(STD_OUTPUT_HANDLE);
     // FATAL,ERROR,WARN,INFO,DEBUG,TRACE
@@ -126,6 +154,32 @@ void platform_console_write_error(const char* message, u8 colour) {
 
 }
 
+static f64 get_clock_frequency() {
+    static f64 clock_frequency = 0;
+    if (!clock_frequency) {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        clock_frequency = 1.0 / (f64)frequency.QuadPart;
+    }
+    return clock_frequency;
+}
+
+f64 platform_get_absolute_time() {
+    LARGE_INTEGER now_time;
+    QueryPerformanceCounter(&now_time);
+    return (f64)now_time.QuadPart * get_clock_frequency();
+}
+
+f64 platform_clock_to_seconds(u64 timestamp) {
+    return (f64)timestamp * get_clock_frequency();
+}
+
+u32 platform_get_processor_count() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
 LRESULT CALLBACK win32_process_message(HWND hwnd, u32 msg, WPARAM w_param, LPARAM l_param) {
     switch (msg) {
         case WM_ERASEBKGND:
@@ -140,13 +194,51 @@ LRESULT CALLBACK win32_process_message(HWND hwnd, u32 msg, WPARAM w_param, LPARA
             return 0;
         case WM_SIZE: {
             // Get the updated size.
-            // RECT r;
-            // GetClientRect(hwnd, &r);
-            // u32 width = r.right - r.left;
-            // u32 height = r.bottom - r.top;
-
-            // TODO: Fire an event for window resize.
+            RECT r;
+            GetClientRect(hwnd, &r);
+            u32 width = r.right - r.left;
+            u32 height = r.bottom - r.top;
+
+            // Minimized.
+            if (!width || !height) break;
+
+            EventContext ctx = {0};
+            ctx.data.u16[0] = width;
+            ctx.data.u16[1] = height;
+            event_post(EVENT_CODE_RESIZED, 0, ctx);
+        } break;
+        case WM_KEYDOWN:
+        case WM_SYSKEYDOWN:
+        case WM_KEYUP:
+        case WM_SYSKEYUP: {
+            b8 pressed = (msg == WM_KEYDOWN || msg == WM_SYSKEYDOWN);
+            // Key codes are the virtual key codes already.
+            input_process_key((Keys)w_param, pressed);
+        } break;
+        case WM_KILLFOCUS:
+            input_release_all();
+            break;
+        case WM_MOUSEMOVE:
+            input_process_mouse_move(GET_X_LPARAM(l_param), GET_Y_LPARAM(l_param));
+            break;
+        case WM_MOUSEWHEEL: {
+            i32 z_delta = GET_WHEEL_DELTA_WPARAM(w_param);
+            if (z_delta != 0) {
+                input_process_mouse_wheel(z_delta / WHEEL_DELTA);
+            }
         } break;
+        case WM_LBUTTONDOWN:
+        case WM_LBUTTONUP:
+            input_process_button(BUTTON_LEFT, msg == WM_LBUTTONDOWN);
+            break;
+        case WM_RBUTTONDOWN:
+        case WM_RBUTTONUP:
+            input_process_button(BUTTON_RIGHT, msg == WM_RBUTTONDOWN);
+            break;
+        case WM_MBUTTONDOWN:
+        case WM_MBUTTONUP:
+            input_process_button(BUTTON_MIDDLE, msg == WM_MBUTTONDOWN);
+            break;
     }
 
     return DefWindowProcA(hwnd, msg, w_param, l_param);
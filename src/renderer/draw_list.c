@@ -0,0 +1,102 @@
+#include "draw_list.h"
+#include "core/arena.h"
+#include "core/asserts.h"
+
+#include <string.h>
+
+// Below this many draws an insertion sort beats building the histograms.
+#define DRAW_LIST_INSERTION_SORT_MAX 32
+
+typedef struct draw_list_state {
+    DrawItem* items;
+    DrawItem* scratch; // Same capacity as items, the radix sort ping-pongs between the two
+    u32 capacity;
+    u32 count;
+} draw_list_state;
+
+static draw_list_state state;
+
+u64 draw_key(u32 pipeline_id, f32 depth) {
+    // The bits of a non-negative float sort in the same order as its value.
+    u32 depth_bits = 0;
+    if (depth > 0.0f) memcpy(&depth_bits, &depth, sizeof(u32));
+    return ((u64)pipeline_id << 32) | depth_bits;
+}
+
+void draw_list_begin(u32 max_draws) {
+    Arena* arena = arena_frame();
+    state.items = ARENA_PUSH(arena, DrawItem, max_draws);
+    state.scratch = ARENA_PUSH(arena, DrawItem, max_draws);
+    state.capacity = max_draws;
+    state.count = 0;
+}
+
+void draw_list_push(u64 key, u32 draw) {
+    REXASSERT(state.count < state.capacity);
+    state.items[state.count++] = (DrawItem){key, draw};
+}
+
+static void insertion_sort(DrawItem* items, u32 count) {
+    for (u32 i = 1; i < count; i++) {
+        DrawItem item = items[i];
+        u32 j = i;
+        while (j > 0 && items[j - 1].key > item.key) {
+            items[j] = items[j - 1];
+            j--;
+        }
+        items[j] = item;
+    }
+}
+
+void draw_list_sort() {
+    if (state.count <= DRAW_LIST_INSERTION_SORT_MAX) {
+        insertion_sort(state.items, state.count);
+        return;
+    }
+
+    // LSD radix sort, one byte per pass. All eight histograms are built in a single read.
+    u32 histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+    for (u32 i = 0; i < state.count; i++) {
+        u64 key = state.items[i].key;
+        for (u32 pass = 0; pass < 8; pass++) {
+            histograms[pass][(key >> (pass * 8)) & 0xFF]++;
+        }
+    }
+
+    DrawItem* src = state.items;
+    DrawItem* dst = state.scratch;
+    for (u32 pass = 0; pass < 8; pass++) {
+        u32* histogram = histograms[pass];
+        u32 shift = pass * 8;
+
+        // Every key has the same byte here, which is common for the pipeline bytes.
+        if (histogram[(src[0].key >> shift) & 0xFF] == state.count) continue;
+
+        u32 offset = 0;
+        for (u32 byte = 0; byte < 256; byte++) {
+            u32 count = histogram[byte];
+            histogram[byte] = offset;
+            offset += count;
+        }
+
+        for (u32 i = 0; i < state.count; i++) {
+            dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+        }
+
+        DrawItem* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    // An odd number of passes left the result in the scratch buffer.
+    if (src != state.items) {
+        state.scratch = state.items;
+        state.items = src;
+    }
+}
+
+const DrawItem* draw_list_items(u32* out_count) {
+    *out_count = state.count;
+    return state.items;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "defines.h"
+
+/*
+ * Draws of the opaque pass, recorded in whatever order the scene produces them and sorted by
+ * a 64-bit key before being submitted. The key holds the pipeline in the high 32 bits and the
+ * depth in the low ones, so draws are grouped by pipeline to save binds and go front to back
+ * within a pipeline, letting early depth testing reject the fragments behind them.
+ */
+
+typedef struct DrawItem {
+    u64 key;
+    u32 draw; // Index into the caller's draws
+} DrawItem;
+
+/**
+ * Packs a sort key.
+ * @param pipeline_id Any id that is equal for draws using the same pipeline.
+ * @param depth View depth of the draw, smaller is closer. Negative values sort as 0.
+ * @returns The key, sorting ascending orders by pipeline and then front to back.
+ */
+u64 draw_key(u32 pipeline_id, f32 depth);
+
+/**
+ * Starts an empty list in the current frame arena, valid until the arena is reset.
+ * @param max_draws Number of draws that will be pushed at most.
+ */
+void draw_list_begin(u32 max_draws);
+
+/**
+ * @param key Sort key, see draw_key.
+ * @param draw Index returned with the item once sorted.
+ */
+void draw_list_push(u64 key, u32 draw);
+
+// Sorts the draws by key, stable for equal keys.
+void draw_list_sort();
+
+/**
+ * @param out_count Number of draws.
+ * @returns The draws, in sorted order after draw_list_sort.
+ */
+const DrawItem* draw_list_items(u32* out_count);
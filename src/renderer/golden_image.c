@@ -0,0 +1,111 @@
+#include "golden_image.h"
+#include "core/rexmemory.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Skips whitespace and comments, then reads one number of a PPM header.
+static b8 read_header_value(FILE* file, u32* out_value) {
+    i32 c = fgetc(file);
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '#') {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) c = fgetc(file);
+        }
+        c = fgetc(file);
+    }
+
+    if (c < '0' || c > '9') return false;
+    u32 value = 0;
+    while (c >= '0' && c <= '9') {
+        value = value * 10 + (c - '0');
+        c = fgetc(file);
+    }
+    // The single whitespace after the last value is consumed with it, the pixels start next.
+    *out_value = value;
+    return true;
+}
+
+b8 golden_image_exists(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+    fclose(file);
+    return true;
+}
+
+b8 golden_image_write(const char* path, const void* pixels, u32 width, u32 height, u32 row_pitch) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+    u8* row = rexallocate(width * 3, MEMORY_TAG_RENDERER);
+    for (u32 y = 0; y < height; y++) {
+        const u8* source = (const u8*)pixels + (u64)y * row_pitch;
+        for (u32 x = 0; x < width; x++) {
+            row[x * 3 + 0] = source[x * 4 + 2];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 0];
+        }
+        fwrite(row, 1, width * 3, file);
+    }
+    rexfree(row);
+
+    b8 written = !ferror(file);
+    fclose(file);
+    return written;
+}
+
+b8 golden_image_compare(const char* path, const void* pixels, u32 width, u32 height, u32 row_pitch, GoldenComparison* out_comparison) {
+    memset(out_comparison, 0, sizeof(GoldenComparison));
+
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+
+    u32 golden_width, golden_height, max_value;
+    if (fgetc(file) != 'P' || fgetc(file) != '6' || !read_header_value(file, &golden_width) ||
+        !read_header_value(file, &golden_height) || !read_header_value(file, &max_value) || max_value != 255) {
+        fclose(file);
+        return false;
+    }
+
+    if (golden_width != width || golden_height != height) {
+        fclose(file);
+        return true;
+    }
+    out_comparison->size_matches = true;
+
+    u8* row = rexallocate(width * 3, MEMORY_TAG_RENDERER);
+    b8 complete = true;
+    u64 squared_error = 0;
+    for (u32 y = 0; y < height; y++) {
+        if (fread(row, 1, width * 3, file) != width * 3) {
+            complete = false;
+            break;
+        }
+
+        const u8* source = (const u8*)pixels + (u64)y * row_pitch;
+        for (u32 x = 0; x < width; x++) {
+            // Golden images are RGB, the pixels BGR.
+            i32 deltas[3] = {
+                (i32)row[x * 3 + 0] - source[x * 4 + 2],
+                (i32)row[x * 3 + 1] - source[x * 4 + 1],
+                (i32)row[x * 3 + 2] - source[x * 4 + 0],
+            };
+            b8 differs = false;
+            for (u32 channel = 0; channel < 3; channel++) {
+                u32 delta = deltas[channel] < 0 ? -deltas[channel] : deltas[channel];
+                if (delta > out_comparison->max_delta) out_comparison->max_delta = delta;
+                squared_error += (u64)delta * delta;
+                differs |= delta != 0;
+            }
+            out_comparison->differing_pixels += differs;
+        }
+    }
+    rexfree(row);
+    fclose(file);
+    if (!complete) return false;
+
+    f64 mean_squared_error = (f64)squared_error / ((f64)width * height * 3);
+    out_comparison->psnr = mean_squared_error > 0 ? 10.0 * log10(255.0 * 255.0 / mean_squared_error) : INFINITY;
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "defines.h"
+
+/*
+ * Golden images, reference renders stored as binary PPM files that later frames are compared
+ * against to catch changes in the output. Pixels are taken as the readback buffers hold them,
+ * 32 bits each, blue green red and one unused byte.
+ */
+
+typedef struct GoldenComparison {
+    b8 size_matches;      // Nothing else is filled in otherwise
+    u32 max_delta;        // Largest difference of a single channel, 0 to 255
+    f64 psnr;             // Peak signal to noise ratio over every channel in dB, INFINITY if equal
+    u64 differing_pixels; // Pixels with any channel different
+} GoldenComparison;
+
+// TRUE if there is a golden image at path, readable or not.
+b8 golden_image_exists(const char* path);
+
+/**
+ * @param path File written, replaced if it exists.
+ * @param pixels First row of the image.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @param row_pitch Bytes between the start of two rows.
+ */
+b8 golden_image_write(const char* path, const void* pixels, u32 width, u32 height, u32 row_pitch);
+
+/**
+ * @param path Golden image to compare against.
+ * @param pixels First row of the image.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @param row_pitch Bytes between the start of two rows.
+ * @param out_comparison How much the images differ.
+ * @returns FALSE if the golden image couldn't be read.
+ */
+b8 golden_image_compare(const char* path, const void* pixels, u32 width, u32 height, u32 row_pitch, GoldenComparison* out_comparison);
@@ -0,0 +1,79 @@
+#include "resolution_scaler.h"
+#include "core/logger.h"
+
+#include <math.h>
+
+// Scales are multiples of this, so small changes in GPU time don't recreate the swapchain.
+#define SCALER_STEP 0.05f
+// Weight of the newest frame in the average GPU time.
+#define SCALER_SMOOTHING 0.1
+// Frames rendered at a new scale before judging it, the first ones pay for the resize.
+#define SCALER_SETTLE_FRAMES 30
+// Only scale up while under this fraction of the target, so it doesn't bounce between steps.
+#define SCALER_RAISE_THRESHOLD 0.8
+// Scaling up aims this far under the target, for the same reason.
+#define SCALER_RAISE_TARGET 0.9
+
+typedef struct scaler_state {
+    b8 enabled;
+    f64 target;
+    f32 min_scale;
+    f32 scale;
+
+    f64 average;
+    u32 frames; // since the last change
+} scaler_state;
+
+static scaler_state state = {.scale = 1.0f};
+
+void resolution_scaler_initialize(f64 target, f32 min_scale) {
+    state.enabled = true;
+    state.target = target;
+    state.min_scale = min_scale;
+    state.scale = 1.0f;
+    state.average = 0;
+    state.frames = 0;
+    REXINFO("Dynamic resolution targeting %.2fms of GPU time", target * 1000.0);
+}
+
+void resolution_scaler_shutdown() {
+    state.enabled = false;
+    state.scale = 1.0f;
+}
+
+static f32 snap_down(f32 scale) {
+    // The epsilon keeps exact steps from falling to the one below.
+    return floorf(scale / SCALER_STEP + 0.001f) * SCALER_STEP;
+}
+
+b8 resolution_scaler_update(f64 gpu_time) {
+    if (!state.enabled || gpu_time <= 0) return false;
+
+    if (state.frames == 0) state.average = gpu_time;
+    else state.average += (gpu_time - state.average) * SCALER_SMOOTHING;
+    state.frames++;
+
+    if (state.frames < SCALER_SETTLE_FRAMES) return false;
+
+    // GPU time follows the pixel count, which is the square of the scale.
+    f32 next = state.scale;
+    if (state.average > state.target) {
+        next = snap_down(state.scale * sqrtf(state.target / state.average));
+        if (next >= state.scale) next = state.scale - SCALER_STEP;
+    } else if (state.average < state.target * SCALER_RAISE_THRESHOLD) {
+        next = snap_down(state.scale * sqrtf(state.target * SCALER_RAISE_TARGET / state.average));
+    }
+
+    if (next < state.min_scale) next = state.min_scale;
+    if (next > 1.0f) next = 1.0f;
+    if (fabsf(next - state.scale) < SCALER_STEP * 0.5f) return false;
+
+    REXDEBUG("Render scale %.2f -> %.2f, GPU time %.2fms", state.scale, next, state.average * 1000.0);
+    state.scale = next;
+    state.frames = 0;
+    return true;
+}
+
+f32 resolution_scaler_get_scale() {
+    return state.scale;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "defines.h"
+
+/*
+ * Dynamic resolution for GPU bound frames. Fed the GPU time of every frame, it picks the
+ * fraction of the full resolution to render at so frames take about the target time, and
+ * the compositor scales them up to the window. The scale moves in fixed steps and is left
+ * alone for a while after each change, since every change recreates the swapchain.
+ */
+
+/**
+ * @param target GPU time per frame to aim for, in seconds.
+ * @param min_scale Lowest fraction of the full width and height to render at.
+ */
+void resolution_scaler_initialize(f64 target, f32 min_scale);
+void resolution_scaler_shutdown();
+
+/**
+ * Called once per finished frame.
+ * @param gpu_time GPU time of the frame, in seconds.
+ * @returns TRUE if the scale changed and the render resolution should follow.
+ */
+b8 resolution_scaler_update(f64 gpu_time);
+
+// Fraction of the full width and height to render at, 1.0 while the scaler is off.
+f32 resolution_scaler_get_scale();
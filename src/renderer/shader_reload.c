@@ -0,0 +1,230 @@
+#include "shader_reload.h"
+#include "core/logger.h"
+
+#ifdef PLATFORM_WAYLAND
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+// Editors usually write a file in several steps, so changes are collected for a short
+// while before anything is compiled.
+#define SHADER_RELOAD_DEBOUNCE_MS 50
+#define SHADER_RELOAD_QUEUE_SIZE 16
+
+typedef struct shader_reload_state {
+    char source_dir[256];
+    char output_dir[256];
+
+    i32 inotify_fd;
+    i32 watch_fd;
+    i32 wake_fd;
+    pthread_t thread;
+    b8 running;
+
+    // Finished compilations, produced by the watcher thread and consumed by the main thread.
+    pthread_mutex_t mutex;
+    char ready[SHADER_RELOAD_QUEUE_SIZE][SHADER_RELOAD_MAX_NAME];
+    u32 ready_head;
+    u32 ready_count;
+} shader_reload_state;
+
+static shader_reload_state state;
+
+static b8 is_shader_source(const char* name) {
+    const char* ext = strrchr(name, '.');
+    if (!ext) return false;
+    return !strcmp(ext, ".vert") || !strcmp(ext, ".frag") || !strcmp(ext, ".comp");
+}
+
+static b8 compile_shader(const char* name) {
+    char src[512];
+    char dst[512];
+    char tmp[512];
+    snprintf(src, sizeof(src), "%s/%s", state.source_dir, name);
+    snprintf(dst, sizeof(dst), "%s/%s.spv", state.output_dir, name);
+    snprintf(tmp, sizeof(tmp), "%s/%s.spv.tmp", state.output_dir, name);
+
+    char* argv[] = {"glslc", src, "-o", tmp, 0};
+    pid_t pid;
+    if (posix_spawnp(&pid, "glslc", 0, 0, argv, environ) != 0) {
+        REXERROR("failed to spawn glslc for [%s]", name);
+        return false;
+    }
+
+    i32 status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        REXERROR("failed to compile shader [%s]", name);
+        unlink(tmp);
+        return false;
+    }
+
+    // The renderer may be reading the old binary, so replace it atomically.
+    if (rename(tmp, dst) != 0) {
+        REXERROR("failed to replace [%s]", dst);
+        return false;
+    }
+    return true;
+}
+
+static void push_ready(const char* name) {
+    pthread_mutex_lock(&state.mutex);
+    if (state.ready_count == SHADER_RELOAD_QUEUE_SIZE) {
+        REXWARN("Shader reload queue is full, dropping [%s]", name);
+    } else {
+        u32 slot = (state.ready_head + state.ready_count) % SHADER_RELOAD_QUEUE_SIZE;
+        strncpy(state.ready[slot], name, SHADER_RELOAD_MAX_NAME - 1);
+        state.ready[slot][SHADER_RELOAD_MAX_NAME - 1] = 0;
+        state.ready_count++;
+    }
+    pthread_mutex_unlock(&state.mutex);
+}
+
+static void* watch_thread(void* arg) {
+    char changed[SHADER_RELOAD_QUEUE_SIZE][SHADER_RELOAD_MAX_NAME];
+    u32 changed_count = 0;
+    _Alignas(struct inotify_event) char buffer[4096];
+
+    while (state.running) {
+        struct pollfd fds[2] = {
+            {state.inotify_fd, POLLIN, 0},
+            {state.wake_fd, POLLIN, 0},
+        };
+        i32 timeout = changed_count ? SHADER_RELOAD_DEBOUNCE_MS : -1;
+        i32 result = poll(fds, 2, timeout);
+        if (result < 0 && errno != EINTR) break;
+        if (fds[1].revents & POLLIN) break;
+
+        if (result > 0 && (fds[0].revents & POLLIN)) {
+            ssize_t length = read(state.inotify_fd, buffer, sizeof(buffer));
+            for (char* ptr = buffer; length > 0 && ptr < buffer + length;) {
+                struct inotify_event* event = (struct inotify_event*)ptr;
+                ptr += sizeof(struct inotify_event) + event->len;
+
+                if (!event->len || !is_shader_source(event->name)) continue;
+
+                b8 known = false;
+                for (u32 i = 0; i < changed_count; i++) {
+                    if (!strcmp(changed[i], event->name)) known = true;
+                }
+                if (!known && changed_count < SHADER_RELOAD_QUEUE_SIZE) {
+                    strncpy(changed[changed_count], event->name, SHADER_RELOAD_MAX_NAME - 1);
+                    changed[changed_count][SHADER_RELOAD_MAX_NAME - 1] = 0;
+                    changed_count++;
+                }
+            }
+            continue;
+        }
+
+        // Quiet for a whole debounce window, compile what changed.
+        for (u32 i = 0; i < changed_count; i++) {
+            REXINFO("Recompiling shader [%s]...", changed[i]);
+            if (compile_shader(changed[i])) {
+                push_ready(changed[i]);
+            }
+        }
+        changed_count = 0;
+    }
+
+    return 0;
+}
+
+b8 shader_reload_initialize(const char* source_dir, const char* output_dir) {
+    memset(&state, 0, sizeof(state));
+    strncpy(state.source_dir, source_dir, sizeof(state.source_dir) - 1);
+    strncpy(state.output_dir, output_dir, sizeof(state.output_dir) - 1);
+
+    state.inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (state.inotify_fd < 0) {
+        REXERROR("failed to initialize inotify!");
+        return false;
+    }
+
+    state.watch_fd = inotify_add_watch(state.inotify_fd, source_dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (state.watch_fd < 0) {
+        REXERROR("failed to watch shader directory [%s]", source_dir);
+        close(state.inotify_fd);
+        return false;
+    }
+
+    // Wakes the watcher thread on shutdown, it would wait for a shader change otherwise.
+    state.wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (state.wake_fd < 0) {
+        REXERROR("failed to create the shader watcher wake event!");
+        inotify_rm_watch(state.inotify_fd, state.watch_fd);
+        close(state.inotify_fd);
+        return false;
+    }
+
+    pthread_mutex_init(&state.mutex, 0);
+    state.running = true;
+
+    if (pthread_create(&state.thread, 0, watch_thread, 0) != 0) {
+        REXERROR("failed to start shader watcher thread!");
+        state.running = false;
+        close(state.wake_fd);
+        close(state.inotify_fd);
+        return false;
+    }
+
+    REXINFO("Watching shaders in [%s]", source_dir);
+    return true;
+}
+
+void shader_reload_shutdown() {
+    if (!state.running) return;
+
+    state.running = false;
+    u64 value = 1;
+    if (write(state.wake_fd, &value, sizeof(value)) != sizeof(value)) {
+        // The thread would never wake up, cancel it in its poll instead.
+        REXERROR("failed to wake the shader watcher thread!");
+        pthread_cancel(state.thread);
+    }
+    pthread_join(state.thread, 0);
+
+    inotify_rm_watch(state.inotify_fd, state.watch_fd);
+    close(state.inotify_fd);
+    close(state.wake_fd);
+    pthread_mutex_destroy(&state.mutex);
+}
+
+b8 shader_reload_poll(char out_name[SHADER_RELOAD_MAX_NAME]) {
+    if (!state.running) return false;
+
+    b8 found = false;
+    pthread_mutex_lock(&state.mutex);
+    if (state.ready_count) {
+        memcpy(out_name, state.ready[state.ready_head], SHADER_RELOAD_MAX_NAME);
+        state.ready_head = (state.ready_head + 1) % SHADER_RELOAD_QUEUE_SIZE;
+        state.ready_count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&state.mutex);
+    return found;
+}
+
+#else
+
+b8 shader_reload_initialize(const char* source_dir, const char* output_dir) {
+    REXWARN("Shader hot reload is not supported on this platform");
+    return false;
+}
+
+void shader_reload_shutdown() {}
+
+b8 shader_reload_poll(char out_name[SHADER_RELOAD_MAX_NAME]) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+#include "defines.h"
+
+#define SHADER_RELOAD_MAX_NAME 128
+
+/**
+ * Starts watching a directory of GLSL sources. Every time a `.vert`, `.frag` or `.comp`
+ * file is written, it is recompiled to `<output_dir>/<name>.spv` on a background thread.
+ * @param source_dir Directory containing the GLSL sources.
+ * @param output_dir Directory the SPIR-V binaries are written to.
+ * @returns FALSE if the watcher could not be started.
+ */
+b8 shader_reload_initialize(const char* source_dir, const char* output_dir);
+void shader_reload_shutdown();
+
+/**
+ * Pops the next shader that finished recompiling. Meant to be called once per frame on the
+ * main thread, until it returns FALSE.
+ * @param out_name Receives the source file name, e.g. "triangle.vert".
+ * @returns TRUE if a recompiled shader was popped.
+ */
+b8 shader_reload_poll(char out_name[SHADER_RELOAD_MAX_NAME]);
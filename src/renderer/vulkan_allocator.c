@@ -0,0 +1,256 @@
+#include "vulkan_allocator.h"
+#include "core/logger.h"
+#include "core/rexmemory.h"
+
+#include <stdatomic.h>
+#include <string.h>
+#include <threads.h>
+
+// Size classes are powers of two from 16 bytes to 4KB.
+#define POOL_MIN_SHIFT 4
+#define POOL_CLASS_COUNT 9
+#define POOL_MAX_SIZE (1 << (POOL_MIN_SHIFT + POOL_CLASS_COUNT - 1))
+// Memory taken from rexallocate at once, carved into blocks of one class.
+#define POOL_PAGE_SIZE (64 * 1024)
+// Blocks not from a pool.
+#define LARGE_CLASS 0xFFFF
+
+#define SCOPE_COUNT (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+
+// Right before every block handed to the driver. Also keeps pool blocks 16 byte aligned.
+typedef struct block_header {
+    u64 size;       // Requested size
+    u16 size_class; // Pool index or LARGE_CLASS
+    u16 scope;
+    u32 offset;     // Large blocks, from the start of the rexallocate'd memory to the block
+} block_header;
+
+typedef struct pool_page {
+    struct pool_page* next;
+    u64 padding; // Keeps the blocks 16 byte aligned
+} pool_page;
+
+typedef struct free_block {
+    struct free_block* next;
+} free_block;
+
+typedef struct size_pool {
+    mtx_t mutex;
+    free_block* free_list; // Points past the header of each free block
+    pool_page* pages;
+} size_pool;
+
+typedef struct scope_counters {
+    _Atomic u64 bytes;
+    _Atomic u64 peak_bytes;
+    _Atomic u64 count;
+    _Atomic u64 total_count;
+    _Atomic u64 pooled_count;
+} scope_counters;
+
+typedef struct vulkan_allocator_state {
+    size_pool pools[POOL_CLASS_COUNT];
+    scope_counters scopes[SCOPE_COUNT];
+} vulkan_allocator_state;
+
+static vulkan_allocator_state state;
+
+static const char* scope_names[SCOPE_COUNT] = {
+    "COMMAND",
+    "OBJECT",
+    "CACHE",
+    "DEVICE",
+    "INSTANCE",
+};
+
+static block_header* get_header(void* block) {
+    return (block_header*)block - 1;
+}
+
+static u32 size_class_of(u64 size) {
+    u32 size_class = 0;
+    while ((1ull << (size_class + POOL_MIN_SHIFT)) < size) size_class++;
+    return size_class;
+}
+
+static u64 class_size(u32 size_class) {
+    return 1ull << (size_class + POOL_MIN_SHIFT);
+}
+
+static void track_allocation(u32 scope, u64 size, b8 pooled) {
+    scope_counters* counters = &state.scopes[scope];
+    u64 bytes = atomic_fetch_add_explicit(&counters->bytes, size, memory_order_relaxed) + size;
+    atomic_fetch_add_explicit(&counters->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counters->total_count, 1, memory_order_relaxed);
+    if (pooled) atomic_fetch_add_explicit(&counters->pooled_count, 1, memory_order_relaxed);
+
+    u64 peak = atomic_load_explicit(&counters->peak_bytes, memory_order_relaxed);
+    while (bytes > peak && !atomic_compare_exchange_weak_explicit(&counters->peak_bytes, &peak, bytes, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static void track_free(u32 scope, u64 size) {
+    atomic_fetch_sub_explicit(&state.scopes[scope].bytes, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&state.scopes[scope].count, 1, memory_order_relaxed);
+}
+
+// Called with the pool locked.
+static b8 pool_grow(size_pool* pool, u32 size_class) {
+    pool_page* page = rexallocate(POOL_PAGE_SIZE, MEMORY_TAG_VULKAN);
+    if (!page) return false;
+    page->next = pool->pages;
+    pool->pages = page;
+
+    u64 stride = sizeof(block_header) + class_size(size_class);
+    u8* slot = (u8*)(page + 1);
+    u8* end = (u8*)page + POOL_PAGE_SIZE;
+    for (; slot + stride <= end; slot += stride) {
+        free_block* block = (free_block*)(slot + sizeof(block_header));
+        block->next = pool->free_list;
+        pool->free_list = block;
+    }
+    return true;
+}
+
+static void* pool_allocate(u32 size_class) {
+    size_pool* pool = &state.pools[size_class];
+    mtx_lock(&pool->mutex);
+    if (!pool->free_list && !pool_grow(pool, size_class)) {
+        mtx_unlock(&pool->mutex);
+        return 0;
+    }
+    free_block* block = pool->free_list;
+    pool->free_list = block->next;
+    mtx_unlock(&pool->mutex);
+    return block;
+}
+
+static void pool_free(void* memory, u32 size_class) {
+    size_pool* pool = &state.pools[size_class];
+    free_block* block = memory;
+    mtx_lock(&pool->mutex);
+    block->next = pool->free_list;
+    pool->free_list = block;
+    mtx_unlock(&pool->mutex);
+}
+
+static void* allocate(u64 size, u64 alignment, u32 scope) {
+    if (scope >= SCOPE_COUNT) scope = VK_SYSTEM_ALLOCATION_SCOPE_OBJECT;
+
+    void* memory;
+    u32 size_class;
+    // Pool blocks are only 16 byte aligned.
+    if (size <= POOL_MAX_SIZE && alignment <= sizeof(block_header)) {
+        size_class = size_class_of(size);
+        memory = pool_allocate(size_class);
+        if (!memory) return 0;
+    } else {
+        // Room for the header in front of the block without breaking its alignment.
+        if (alignment < sizeof(block_header)) alignment = sizeof(block_header);
+        u8* base = rexallocate_aligned(alignment + size, alignment, MEMORY_TAG_VULKAN);
+        if (!base) return 0;
+        memory = base + alignment;
+        size_class = LARGE_CLASS;
+        get_header(memory)->offset = (u32)alignment;
+    }
+
+    block_header* header = get_header(memory);
+    header->size = size;
+    header->size_class = size_class;
+    header->scope = scope;
+    track_allocation(scope, size, size_class != LARGE_CLASS);
+    return memory;
+}
+
+static void free_block_memory(void* memory) {
+    block_header* header = get_header(memory);
+    track_free(header->scope, header->size);
+    if (header->size_class == LARGE_CLASS) {
+        rexfree((u8*)memory - header->offset);
+    } else {
+        pool_free(memory, header->size_class);
+    }
+}
+
+static void* VKAPI_CALL allocation(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    return allocate(size, alignment, scope);
+}
+
+static void* VKAPI_CALL reallocation(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    if (!original) return allocate(size, alignment, scope);
+    // A size of 0 frees the block, as with realloc.
+    if (!size) {
+        free_block_memory(original);
+        return 0;
+    }
+
+    // Still fits its pool block, only the statistics change.
+    block_header* header = get_header(original);
+    if (header->size_class != LARGE_CLASS && size <= class_size(header->size_class) && alignment <= sizeof(block_header)) {
+        track_free(header->scope, header->size);
+        track_allocation(header->scope, size, true);
+        header->size = size;
+        return original;
+    }
+
+    void* memory = allocate(size, alignment, scope);
+    if (!memory) return 0;
+    memcpy(memory, original, header->size < size ? header->size : size);
+    free_block_memory(original);
+    return memory;
+}
+
+static void VKAPI_CALL free_function(void* user_data, void* memory) {
+    if (memory) free_block_memory(memory);
+}
+
+static const VkAllocationCallbacks callbacks = {
+    .pUserData = 0,
+    .pfnAllocation = allocation,
+    .pfnReallocation = reallocation,
+    .pfnFree = free_function,
+};
+
+void vulkan_allocator_initialize() {
+    memset(&state, 0, sizeof(vulkan_allocator_state));
+    for (u32 i = 0; i < POOL_CLASS_COUNT; i++) {
+        mtx_init(&state.pools[i].mutex, mtx_plain);
+    }
+}
+
+void vulkan_allocator_shutdown() {
+    for (u32 i = 0; i < POOL_CLASS_COUNT; i++) {
+        size_pool* pool = &state.pools[i];
+        while (pool->pages) {
+            pool_page* next = pool->pages->next;
+            rexfree(pool->pages);
+            pool->pages = next;
+        }
+        pool->free_list = 0;
+        mtx_destroy(&pool->mutex);
+    }
+}
+
+const VkAllocationCallbacks* vulkan_allocator_callbacks() {
+    return &callbacks;
+}
+
+void vulkan_allocator_get_stats(VkSystemAllocationScope scope, VulkanAllocatorStats* out_stats) {
+    scope_counters* counters = &state.scopes[scope];
+    out_stats->bytes = atomic_load_explicit(&counters->bytes, memory_order_relaxed);
+    out_stats->peak_bytes = atomic_load_explicit(&counters->peak_bytes, memory_order_relaxed);
+    out_stats->count = atomic_load_explicit(&counters->count, memory_order_relaxed);
+    out_stats->total_count = atomic_load_explicit(&counters->total_count, memory_order_relaxed);
+    out_stats->pooled_count = atomic_load_explicit(&counters->pooled_count, memory_order_relaxed);
+}
+
+void vulkan_allocator_log_stats() {
+    REXINFO("Vulkan host memory:  bytes |       peak | allocations |   total | pooled");
+    for (u32 scope = 0; scope < SCOPE_COUNT; scope++) {
+        VulkanAllocatorStats stats;
+        vulkan_allocator_get_stats(scope, &stats);
+        if (!stats.total_count) continue;
+        REXINFO("  %-9s %12llu | %10llu | %11llu | %7llu | %5.1f%%", scope_names[scope], stats.bytes, stats.peak_bytes,
+                stats.count, stats.total_count, 100.0 * stats.pooled_count / stats.total_count);
+    }
+}
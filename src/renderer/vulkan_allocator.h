@@ -0,0 +1,40 @@
+#pragma once
+#include "defines.h"
+
+#include <vulkan/vulkan.h>
+
+/*
+ * Host allocator for the Vulkan driver. Small blocks come from per size class pools that keep
+ * freed blocks for reuse, so the short lived allocations of pipeline creation and command
+ * recording don't reach malloc. Larger or more aligned blocks go straight to rexallocate. The
+ * memory held is counted under MEMORY_TAG_VULKAN, and what the driver asked for is counted
+ * per VkSystemAllocationScope.
+ */
+
+typedef struct VulkanAllocatorStats {
+    u64 bytes;       // Requested by the driver and not freed yet
+    u64 peak_bytes;
+    u64 count;       // Live allocations
+    u64 total_count; // Allocations ever made
+    u64 pooled_count; // Of total_count, served from a pool
+} VulkanAllocatorStats;
+
+void vulkan_allocator_initialize();
+
+// Frees the pools, every object created with the callbacks must be destroyed by then.
+void vulkan_allocator_shutdown();
+
+/**
+ * Host allocation callbacks for every Vulkan create and destroy call.
+ * @returns Callbacks valid between initialize and shutdown.
+ */
+const VkAllocationCallbacks* vulkan_allocator_callbacks();
+
+/**
+ * @param scope Allocation scope, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND to _INSTANCE.
+ * @param out_stats Statistics of that scope.
+ */
+void vulkan_allocator_get_stats(VkSystemAllocationScope scope, VulkanAllocatorStats* out_stats);
+
+// Logs the statistics of every scope.
+void vulkan_allocator_log_stats();
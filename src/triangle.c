@@ -1,20 +1,38 @@
 #include "defines.h"
 #include "core/logger.h"
+#include "core/arena.h"
+#include "core/rexmemory.h"
+#include "core/telemetry.h"
+#include "core/profiler.h"
+#include "core/bench.h"
 #include "core/events.h"
+#include "core/input.h"
+#include "core/jobs.h"
 #include "containers/rexarray.h"
+#include "containers/rexhashmap.h"
+#include "renderer/shader_reload.h"
+#include "renderer/resolution_scaler.h"
+#include "renderer/draw_list.h"
+#include "renderer/vulkan_allocator.h"
+#include "renderer/golden_image.h"
 
 #include "platform/platform.h"
 
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 
 #ifdef PLATFORM_WAYLAND
 #define VK_USE_PLATFORM_WAYLAND_KHR
 #include "platform/linux/platform_wayland.h"
+// Clock platform_get_absolute_time reads, GPU timestamps are calibrated against it.
+#define HOST_TIME_DOMAIN VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT
 #elif PLATFORM_WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
 #include "platform/win32/platform_win32.h"
+#define HOST_TIME_DOMAIN VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT
 #endif
 
 #include <vulkan/vulkan.h>
@@ -36,8 +54,153 @@ typedef struct QueueIndex
     u32 index;
 } QueueIndex;
 
+// The validation layer and debug messenger cost more than a whole frame, release builds go
+// without them.
+#if REXRELEASE == 1
+#define VULKAN_VALIDATION 0
+#else
+#define VULKAN_VALIDATION 1
+#endif
+
+// Initial window size, and the size of headless frames.
+#define WINDOW_WIDTH 1280
+#define WINDOW_HEIGHT 720
+
+// Frames rendered offscreen and read back for software presentation, see draw_frame_software.
+#define SOFTWARE_FRAME_COUNT 3
+
+// Initial sizes of the frame and scratch arenas, they grow if a frame or init step needs more.
+#define ARENA_FRAME_SIZE (64 * 1024)
+#define ARENA_SCRATCH_SIZE (256 * 1024)
+
+// Seconds between two telemetry exports.
+#define TELEMETRY_EXPORT_INTERVAL 1.0
+
+// Timestamps written by each frame, read back once its fence signaled.
+#define GPU_TIMESTAMP_FRAME_BEGIN 0
+#define GPU_TIMESTAMP_RENDER_PASS_END 1
+#define GPU_TIMESTAMP_FRAME_END 2
+#define GPU_TIMESTAMP_COUNT 3
+
+// Frames rendered and thrown away before a benchmark starts measuring.
+#define BENCH_DEFAULT_WARMUP_FRAMES 100
+// Percent a benchmark metric may get worse by compared to the baseline.
+#define BENCH_DEFAULT_THRESHOLD 5.0
+
+// Frames rendered for a golden image check, the last one is compared. The warmup fills the
+// ring of software frames once.
+#define GOLDEN_FRAMES 4
+#define GOLDEN_WARMUP_FRAMES SOFTWARE_FRAME_COUNT
+// Default tolerance of golden image checks, for rounding differences between drivers.
+#define GOLDEN_DEFAULT_MAX_DELTA 2
+#define GOLDEN_DEFAULT_MIN_PSNR 40.0
+// Exit code of a golden image check without a golden image, so the golden target can tell it
+// apart from a mismatch.
+#define GOLDEN_MISSING_EXIT_CODE 2
+
+// Seconds between two calibrations of the GPU clock against the CPU one while tracing, they
+// drift apart slowly.
+#define GPU_CALIBRATION_INTERVAL 1.0
+
+// Dynamic resolution never renders below this fraction of the window width and height.
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f
+
+typedef struct SoftwareFrame
+{
+    VkDeviceMemory image_memory; // The image itself is in swapchain_images
+    VkBuffer readback_buffer;
+    VkDeviceMemory readback_memory;
+    void *readback_data; // Persistently mapped
+    VkCommandBuffer command_buffer;
+    VkFence fence;
+    b8 readback_pending; // Submitted and not presented or superseded yet
+    u64 frame_number;
+} SoftwareFrame;
+
+#define PIPELINE_SHADER_NAME_LENGTH 64
+#define PIPELINE_MAX_SPEC_CONSTANTS 8
+// Past this many variants something is generating permutations it shouldn't.
+#define PIPELINE_VARIANT_BUDGET 256
+// Posted from a compile job once its pipeline is built, the sender is the PipelineVariant.
+#define EVENT_CODE_PIPELINE_COMPILED 0x100
+// Ways to shade the triangle, the same shaders with other specialization constants.
+#define SCENE_STYLE_COUNT 4
+
+// Specialization constants exposed by the shaders, see shader/triangle.*
+typedef enum ShaderConstant
+{
+    SHADER_CONSTANT_FLIP_Y = 0,
+    SHADER_CONSTANT_GRAYSCALE = 1,
+    SHADER_CONSTANT_COLOR_LEVELS = 2,
+} ShaderConstant;
+
+// Full description of a graphics pipeline. Every field is 32 bits wide, so once zeroed by
+// pipeline_desc_init it has no padding and can be hashed and compared as raw bytes.
+typedef struct PipelineDesc
+{
+    char vert_shader_name[PIPELINE_SHADER_NAME_LENGTH];
+    char frag_shader_name[PIPELINE_SHADER_NAME_LENGTH];
+    VkPrimitiveTopology topology;
+    VkCullModeFlags cull_mode;
+    VkFrontFace front_face;
+    u32 depth_test_enable;
+    u32 depth_write_enable;
+    VkCompareOp depth_compare_op;
+    u32 blend_enable;
+
+    // Sorted by id, values are 32-bit scalars (bool, int, uint or float bits).
+    u32 spec_constant_count;
+    u32 spec_constant_ids[PIPELINE_MAX_SPEC_CONSTANTS];
+    u32 spec_constant_values[PIPELINE_MAX_SPEC_CONSTANTS];
+} PipelineDesc;
+
+typedef enum PipelineCompileState
+{
+    PIPELINE_COMPILE_IDLE,
+    PIPELINE_COMPILE_QUEUED,
+    PIPELINE_COMPILE_DONE,
+} PipelineCompileState;
+
+typedef struct PipelineVariant
+{
+    PipelineDesc desc;
+    VkPipeline pipeline; // Used for drawing, VK_NULL_HANDLE until the first compile finished
+
+    // Written by the compile job and handed to the main thread through compile_state.
+    VkPipeline compiled;
+    b8 compile_succeeded;
+    f64 compile_time;
+    _Atomic u32 compile_state;
+    b8 recompile; // Shaders changed while a compile was queued
+    b8 optimize;  // The queued compile links with link time optimization
+} PipelineVariant;
+
+// One of the four parts a pipeline is linked from with VK_EXT_graphics_pipeline_library.
+typedef struct PipelineLibrary
+{
+    PipelineDesc desc; // Only the fields used by the part, see pipeline_desc_library_part
+    VkGraphicsPipelineLibraryFlagsEXT part;
+    VkPipeline library;
+} PipelineLibrary;
+
+// Per draw values of the vertex shader, same layout as its push constant block.
+typedef struct DrawConstants
+{
+    f32 offset[2];
+    f32 scale;
+    f32 depth;
+} DrawConstants;
+
+// One triangle of the scene.
+typedef struct SceneDraw
+{
+    const PipelineDesc *pipeline;
+    DrawConstants constants;
+} SceneDraw;
+
 struct vkstate
 {
+    const VkAllocationCallbacks *allocator; // Passed to every create and destroy call
     VkInstance instance;
     VkDebugUtilsMessengerEXT debug_messenger;
 
@@ -58,8 +221,11 @@ struct vkstate
 
     VkSwapchainKHR swapchain;
     SwapchainSupportDetails swapchain_support;
-    u32 framebuffer_width;
+    u32 window_width;  // Full resolution, in pixels
+    u32 window_height;
+    u32 framebuffer_width;  // Render resolution, the window size scaled by the resolution scaler
     u32 framebuffer_height;
+    b8 swapchain_dirty;     // Recreated before the next frame
     VkSurfaceFormatKHR image_format;
     u32 image_count;
     VkImage *swapchain_images;
@@ -70,25 +236,94 @@ struct vkstate
 
     VkFramebuffer *framebuffers;
 
+    // Multisampled color target, resolved into the swapchain image at the end of the subpass.
+    // Never stored, so on tilers it can live in tile memory only.
+    VkSampleCountFlagBits msaa_samples;
+    VkImage msaa_image;
+    VkDeviceMemory msaa_memory;
+    VkImageView msaa_view;
+
+    // Depth target, cleared and discarded every frame like the multisampled one.
+    VkFormat depth_format;
+    VkImage depth_image;
+    VkDeviceMemory depth_memory;
+    VkImageView depth_view;
+
+    VkPresentModeKHR preferred_present_mode; // Used when supported, FIFO otherwise
+    VkPresentModeKHR present_mode;
+
     VkRenderPass render_pass;
 
     VkPipelineLayout pipeline_layout;
-    VkPipeline graphics_pipeline;
+    VkPipelineCache pipeline_cache;
+    rexhashmap pipeline_variants;  // PipelineVariant* keyed by pipeline_desc_hash
+    u32 pipelines_compiling;
+    _Atomic b8 pipeline_events_dropped; // A compile finished while the event queue was full
+
+    b8 graphics_pipeline_library;   // VK_EXT_graphics_pipeline_library is enabled
+    b8 optimize_linked_pipelines;   // Relink fast linked pipelines with LTO in the background
+    mtx_t pipeline_library_mutex;   // Guards the members below, used by the compile jobs
+    rexhashmap pipeline_libraries;  // PipelineLibrary keyed by part and part desc hash
+    VkPipeline *retired_libraries;  // rexarray, destroyed once no compile is queued
+    _Atomic u32 pipeline_library_generation;
+
+    // Raster, depth and blend state set with vkCmdSet* instead of being baked into pipelines.
+    b8 extended_dynamic_state;
+    b8 dynamic_blend_enable; // VK_EXT_extended_dynamic_state3
+    PFN_vkCmdSetColorBlendEnableEXT cmd_set_color_blend_enable;
+    PipelineDesc pipeline_desc;    // Pipeline used to draw the triangle
+    PipelineDesc scene_styles[SCENE_STYLE_COUNT]; // Layers cycle through them with --shader-variants
+    b8 shader_variants;
+    SceneDraw *scene_draws;
+    u32 scene_draw_count;
+    VkPipeline *retired_pipelines; // rexarray, destroyed once the frame using them finished
 
     VkCommandPool commando_pool;
     VkCommandBuffer command_buffer;
 
     VkSemaphore image_available_semaphore;
-    VkSemaphore render_finished_semaphore;
+    // One per swapchain image: a present may still wait on it after the frame's fence signaled,
+    // it's only free again once its image is acquired again.
+    VkSemaphore *render_finished_semaphores;
     VkFence in_flight_fence;
+
+    // No surface to present to, frames are copied to the window through the platform layer.
+    b8 software_present;
+    // No window at all, frames are rendered and read back like software presentation but never
+    // shown. Runs without a display server.
+    b8 headless;
+    SoftwareFrame software_frames[SOFTWARE_FRAME_COUNT];
+    u64 software_frame_count;
+
+    // GPU_TIMESTAMP_COUNT timestamps per frame slot, read back once the slot's fence signaled.
+    VkQueryPool timestamp_pool;
+    f64 timestamp_period; // Nanoseconds per tick
+    u64 timestamp_mask;   // Timestamps wrap around past the queue's valid bits
+    b8 timestamps_written[SOFTWARE_FRAME_COUNT];
+
+    // VK_EXT_calibrated_timestamps, only enabled while tracing to put GPU work on the timeline.
+    PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps;
+    u64 calibration_gpu_timestamp;
+    f64 calibration_cpu_time; // platform_get_absolute_time at calibration_gpu_timestamp
 };
 
 b8 running = true;
 static struct vkstate vkstate;
 static Window window;
 
+b8 extension_available(const VkExtensionProperties *extensions, u32 extension_count, const char *extension_name)
+{
+    for (u32 i = 0; i < extension_count; i++)
+    {
+        if (!strcmp(extensions[i].extensionName, extension_name))
+            return true;
+    }
+    return false;
+}
+
 b8 create_instance()
 {
+    PROFILE_FUNCTION();
     REXDEBUG("Creating instance...");
     VkApplicationInfo app_info = {VK_STRUCTURE_TYPE_APPLICATION_INFO};
     app_info.pApplicationName = "Triangle";
@@ -100,8 +335,6 @@ b8 create_instance()
     VkInstanceCreateInfo instance_info = {VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
     instance_info.pApplicationInfo = &app_info;
 
-    u32 instance_ext_count = 3;
-    const char **instance_extensions = malloc(sizeof(const char *) * instance_ext_count);
     const char *surface_ext = VK_KHR_SURFACE_EXTENSION_NAME;
     const char *debug_ext = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
 #ifdef PLATFORM_WAYLAND
@@ -109,29 +342,50 @@ b8 create_instance()
 #elif PLATFORM_WIN32
     const char *platform_ext = "VK_KHR_win32_surface";
 #endif
-    instance_extensions[0] = surface_ext;
-    instance_extensions[1] = debug_ext;
-    instance_extensions[2] = platform_ext;
+
+    u32 available_ext_count = 0;
+    vkEnumerateInstanceExtensionProperties(0, &available_ext_count, 0);
+    VkExtensionProperties *available_extensions = ARENA_PUSH(arena_scratch(), VkExtensionProperties, available_ext_count);
+    vkEnumerateInstanceExtensionProperties(0, &available_ext_count, available_extensions);
+    b8 has_surface = extension_available(available_extensions, available_ext_count, surface_ext) &&
+                     extension_available(available_extensions, available_ext_count, platform_ext);
+
+    if (!has_surface && !vkstate.software_present)
+    {
+        REXWARN("%s not available, presenting in software", platform_ext);
+        vkstate.software_present = true;
+    }
+
+    u32 instance_ext_count = 0;
+    const char **instance_extensions = ARENA_PUSH(arena_scratch(), const char *, 3);
+    if (VULKAN_VALIDATION)
+        instance_extensions[instance_ext_count++] = debug_ext;
+    if (!vkstate.software_present)
+    {
+        instance_extensions[instance_ext_count++] = surface_ext;
+        instance_extensions[instance_ext_count++] = platform_ext;
+    }
 
     instance_info.enabledExtensionCount = instance_ext_count;
     instance_info.ppEnabledExtensionNames = instance_extensions;
 
-    u32 instance_layers_count = 1;
-    const char **instance_layers = malloc(sizeof(const char *) * instance_layers_count);
-    const char *validation_layer = "VK_LAYER_KHRONOS_validation";
-    instance_layers[0] = validation_layer;
+    if (VULKAN_VALIDATION)
+    {
+        u32 instance_layers_count = 1;
+        const char **instance_layers = ARENA_PUSH(arena_scratch(), const char *, instance_layers_count);
+        const char *validation_layer = "VK_LAYER_KHRONOS_validation";
+        instance_layers[0] = validation_layer;
 
-    instance_info.enabledLayerCount = instance_layers_count;
-    instance_info.ppEnabledLayerNames = instance_layers;
+        instance_info.enabledLayerCount = instance_layers_count;
+        instance_info.ppEnabledLayerNames = instance_layers;
+    }
 
-    if (vkCreateInstance(&instance_info, 0, &vkstate.instance))
+    if (vkCreateInstance(&instance_info, vkstate.allocator, &vkstate.instance))
     {
         REXFATAL("failed to create instance!");
         return false;
     }
 
-    free(instance_extensions);
-
     return true;
 }
 
@@ -162,6 +416,10 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
 
 b8 setup_debug_messenger()
 {
+    PROFILE_FUNCTION();
+    if (!VULKAN_VALIDATION)
+        return true;
+
     REXDEBUG("Creating debug messenger...");
     VkDebugUtilsMessengerCreateInfoEXT debug_info = {VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT};
     debug_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
@@ -177,7 +435,7 @@ b8 setup_debug_messenger()
         return false;
     }
 
-    if (func(vkstate.instance, &debug_info, 0, &vkstate.debug_messenger) != VK_SUCCESS)
+    if (func(vkstate.instance, &debug_info, vkstate.allocator, &vkstate.debug_messenger) != VK_SUCCESS)
     {
         REXFATAL("failed to create debug messenger!");
         return false;
@@ -188,6 +446,10 @@ b8 setup_debug_messenger()
 
 b8 create_surface()
 {
+    PROFILE_FUNCTION();
+    if (vkstate.software_present)
+        return true;
+
 #ifdef PLATFORM_WAYLAND
     REXDEBUG("Creating wayland surface...");
     WaylandState *state = (WaylandState *)window.internal_state;
@@ -195,10 +457,11 @@ b8 create_surface()
     surface_info.display = state->display;
     surface_info.surface = state->surface;
 
-    if (vkCreateWaylandSurfaceKHR(vkstate.instance, &surface_info, 0, &vkstate.surface) != VK_SUCCESS)
+    if (vkCreateWaylandSurfaceKHR(vkstate.instance, &surface_info, vkstate.allocator, &vkstate.surface) != VK_SUCCESS)
     {
-        REXFATAL("failed to create wayland surface!");
-        return false;
+        REXWARN("failed to create wayland surface, presenting in software");
+        vkstate.surface = VK_NULL_HANDLE;
+        vkstate.software_present = true;
     }
 #elif PLATFORM_WIN32
     REXDEBUG("Creating win32 surface...");
@@ -207,7 +470,7 @@ b8 create_surface()
     surface_info.hwnd = state->hwnd;
     surface_info.hinstance = state->h_instance;
 
-    if (vkCreateWin32SurfaceKHR(vkstate.instance, &surface_info, 0, &vkstate.surface) != VK_SUCCESS)
+    if (vkCreateWin32SurfaceKHR(vkstate.instance, &surface_info, vkstate.allocator, &vkstate.surface) != VK_SUCCESS)
     {
         REXFATAL("failed to create win32 surface!");
         return false;
@@ -224,13 +487,13 @@ b8 query_swapchain_support(VkPhysicalDevice device, SwapchainSupportDetails *out
     vkGetPhysicalDeviceSurfaceFormatsKHR(device, vkstate.surface, &out_swapchain_support->format_count, 0);
     if (!out_swapchain_support->format_count)
         return false;
-    out_swapchain_support->formats = malloc(sizeof(VkSurfaceFormatKHR) * out_swapchain_support->format_count);
+    out_swapchain_support->formats = rexallocate(sizeof(VkSurfaceFormatKHR) * out_swapchain_support->format_count, MEMORY_TAG_RENDERER);
     vkGetPhysicalDeviceSurfaceFormatsKHR(device, vkstate.surface, &out_swapchain_support->format_count, out_swapchain_support->formats);
 
     vkGetPhysicalDeviceSurfacePresentModesKHR(device, vkstate.surface, &out_swapchain_support->present_mode_count, 0);
     if (!out_swapchain_support->present_mode_count)
         return false;
-    out_swapchain_support->present_modes = malloc(sizeof(VkPresentModeKHR) * out_swapchain_support->present_mode_count);
+    out_swapchain_support->present_modes = rexallocate(sizeof(VkPresentModeKHR) * out_swapchain_support->present_mode_count, MEMORY_TAG_RENDERER);
     vkGetPhysicalDeviceSurfacePresentModesKHR(device, vkstate.surface, &out_swapchain_support->present_mode_count, out_swapchain_support->present_modes);
 
     return true;
@@ -239,14 +502,15 @@ b8 query_swapchain_support(VkPhysicalDevice device, SwapchainSupportDetails *out
 void destroy_swapchain_support(SwapchainSupportDetails *swapchain_support)
 {
     if (swapchain_support->formats)
-        free(swapchain_support->formats);
+        rexfree(swapchain_support->formats);
     if (swapchain_support->present_modes)
-        free(swapchain_support->present_modes);
+        rexfree(swapchain_support->present_modes);
     memset(swapchain_support, 0, sizeof(SwapchainSupportDetails));
 }
 
 b8 pick_physical_device()
 {
+    PROFILE_FUNCTION();
     REXDEBUG("Choosing physical device...");
     u32 device_count = 0;
     vkEnumeratePhysicalDevices(vkstate.instance, &device_count, 0);
@@ -257,28 +521,33 @@ b8 pick_physical_device()
         return false;
     }
 
-    VkPhysicalDevice *physical_devices = malloc(sizeof(VkPhysicalDevice) * device_count);
+    VkPhysicalDevice *physical_devices = ARENA_PUSH(arena_scratch(), VkPhysicalDevice, device_count);
     vkEnumeratePhysicalDevices(vkstate.instance, &device_count, physical_devices);
 
     b8 found = false;
 
-    for (u32 i = 0; i < device_count; i++)
+    // Discrete GPUs first, then anything, so integrated GPUs and software rasterizers like
+    // lavapipe still work.
+    for (u32 pass = 0; pass < 2 && !found; pass++)
     {
-        VkPhysicalDeviceProperties properties;
-        vkGetPhysicalDeviceProperties(physical_devices[i], &properties);
-
-        if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
-            continue;
-        if (!query_swapchain_support(physical_devices[i], &vkstate.swapchain_support))
+        for (u32 i = 0; i < device_count; i++)
         {
-            destroy_swapchain_support(&vkstate.swapchain_support);
-            continue;
-        }
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(physical_devices[i], &properties);
 
-        vkstate.physical_device = physical_devices[i];
-        found = true;
-        REXINFO("Selected device: %s", properties.deviceName);
-        break;
+            if (pass == 0 && properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+                continue;
+            if (!vkstate.software_present && !query_swapchain_support(physical_devices[i], &vkstate.swapchain_support))
+            {
+                destroy_swapchain_support(&vkstate.swapchain_support);
+                continue;
+            }
+
+            vkstate.physical_device = physical_devices[i];
+            found = true;
+            REXINFO("Selected device: %s", properties.deviceName);
+            break;
+        }
     }
 
     if (!found)
@@ -286,7 +555,7 @@ b8 pick_physical_device()
 
     u32 queue_family_count = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(vkstate.physical_device, &queue_family_count, 0);
-    VkQueueFamilyProperties *queue_families = malloc(sizeof(VkQueueFamilyProperties) * queue_family_count);
+    VkQueueFamilyProperties *queue_families = ARENA_PUSH(arena_scratch(), VkQueueFamilyProperties, queue_family_count);
     vkGetPhysicalDeviceQueueFamilyProperties(vkstate.physical_device, &queue_family_count, queue_families);
 
     vkstate.graphics_queue_index.family_index = -1;
@@ -349,7 +618,7 @@ b8 pick_physical_device()
             };
         }
 
-        if (vkstate.present_queue_index.family_index == -1)
+        if (!vkstate.software_present && vkstate.present_queue_index.family_index == -1)
         {
             VkBool32 supports_present = VK_FALSE;
             vkGetPhysicalDeviceSurfaceSupportKHR(vkstate.physical_device, i, vkstate.surface, &supports_present);
@@ -375,6 +644,40 @@ b8 pick_physical_device()
         }
     }
 
+    // First of these the device can render depth to, in order of precision.
+    const VkFormat depth_formats[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM};
+    vkstate.depth_format = VK_FORMAT_UNDEFINED;
+    for (u32 i = 0; i < sizeof(depth_formats) / sizeof(depth_formats[0]); i++)
+    {
+        VkFormatProperties format_properties;
+        vkGetPhysicalDeviceFormatProperties(vkstate.physical_device, depth_formats[i], &format_properties);
+        if (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+        {
+            vkstate.depth_format = depth_formats[i];
+            break;
+        }
+    }
+    if (vkstate.depth_format == VK_FORMAT_UNDEFINED)
+    {
+        REXFATAL("No supported depth format!");
+        return false;
+    }
+
+    // Highest supported sample count up to the one asked for.
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(vkstate.physical_device, &device_properties);
+    VkSampleCountFlags supported_samples = device_properties.limits.framebufferColorSampleCounts & device_properties.limits.framebufferDepthSampleCounts;
+    while (vkstate.msaa_samples > VK_SAMPLE_COUNT_1_BIT && !(supported_samples & vkstate.msaa_samples))
+        vkstate.msaa_samples >>= 1;
+    if (vkstate.msaa_samples > VK_SAMPLE_COUNT_1_BIT)
+    {
+        REXINFO("Using %ix MSAA", vkstate.msaa_samples);
+    }
+
+    // Frames are read back on the graphics queue, the device presents nothing.
+    if (vkstate.software_present)
+        vkstate.present_queue_index = vkstate.graphics_queue_index;
+
     REXDEBUG("Queue family index : Queue index ________");
     REXDEBUG(" Graphics | Compute | Transfer | Present |");
     REXDEBUG("   %i:%i    |   %i:%i   |   %i:%i    |   %i:%i   |", vkstate.graphics_queue_index.family_index, vkstate.graphics_queue_index.index, vkstate.compute_queue_index.family_index, vkstate.compute_queue_index.index, vkstate.transfer_queue_index.family_index, vkstate.transfer_queue_index.index, vkstate.present_queue_index.family_index, vkstate.present_queue_index.index);
@@ -386,18 +689,42 @@ b8 pick_physical_device()
         return false;
     }
 
-    free(physical_devices);
-
     return true;
 }
 
+// Calibration needs both the device clock and the one platform_get_absolute_time reads.
+b8 supports_calibrated_timestamps(const VkExtensionProperties *extensions, u32 extension_count)
+{
+    if (!extension_available(extensions, extension_count, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME))
+        return false;
+
+    PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT get_time_domains =
+        (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)vkGetInstanceProcAddr(vkstate.instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+    u32 domain_count = 0;
+    if (!get_time_domains || get_time_domains(vkstate.physical_device, &domain_count, 0) != VK_SUCCESS)
+        return false;
+    VkTimeDomainEXT *domains = ARENA_PUSH(arena_scratch(), VkTimeDomainEXT, domain_count);
+    get_time_domains(vkstate.physical_device, &domain_count, domains);
+
+    b8 has_device_domain = false;
+    b8 has_host_domain = false;
+    for (u32 i = 0; i < domain_count; i++)
+    {
+        if (domains[i] == VK_TIME_DOMAIN_DEVICE_EXT)
+            has_device_domain = true;
+        else if (domains[i] == HOST_TIME_DOMAIN)
+            has_host_domain = true;
+    }
+    return has_device_domain && has_host_domain;
+}
+
 b8 create_logical_device()
 {
+    PROFILE_FUNCTION();
     REXDEBUG("Creating logical device...");
 
     u32 queue_count = rexarray_len(vkstate.queue_count);
-    VkDeviceQueueCreateInfo *queue_info = malloc(sizeof(VkDeviceQueueCreateInfo) * queue_count);
-    memset(queue_info, 0, sizeof(VkDeviceQueueCreateInfo) * queue_count);
+    VkDeviceQueueCreateInfo *queue_info = ARENA_PUSH_ZERO(arena_scratch(), VkDeviceQueueCreateInfo, queue_count);
     f32 queue_priority[] = {1.f, .9f, .8f, .7f, .6f};
     for (u32 i = 0; i < queue_count; i++)
     {
@@ -410,16 +737,94 @@ b8 create_logical_device()
     VkPhysicalDeviceFeatures device_features = {0};
     device_features.samplerAnisotropy = VK_TRUE;
 
-    const char *swapchain_ext = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+    u32 device_ext_count = 0;
+    const char *device_extensions[5];
+    if (!vkstate.software_present)
+        device_extensions[device_ext_count++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+
+    u32 available_ext_count = 0;
+    vkEnumerateDeviceExtensionProperties(vkstate.physical_device, 0, &available_ext_count, 0);
+    VkExtensionProperties *available_extensions = ARENA_PUSH(arena_scratch(), VkExtensionProperties, available_ext_count);
+    vkEnumerateDeviceExtensionProperties(vkstate.physical_device, 0, &available_ext_count, available_extensions);
+
+    b8 has_graphics_pipeline_library =
+        extension_available(available_extensions, available_ext_count, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+        extension_available(available_extensions, available_ext_count, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+    b8 has_extended_dynamic_state3 = extension_available(available_extensions, available_ext_count, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+
+    // Query the optional features, anything unsupported stays VK_FALSE.
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT library_features = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT};
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamic_state3_features = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT};
+    VkPhysicalDeviceFeatures2 features = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    if (has_graphics_pipeline_library)
+    {
+        library_features.pNext = features.pNext;
+        features.pNext = &library_features;
+    }
+    if (has_extended_dynamic_state3)
+    {
+        dynamic_state3_features.pNext = features.pNext;
+        features.pNext = &dynamic_state3_features;
+    }
+    vkGetPhysicalDeviceFeatures2(vkstate.physical_device, &features);
+
+    // Only the features we use are enabled.
+    void *enabled_features = 0;
+
+    vkstate.graphics_pipeline_library = library_features.graphicsPipelineLibrary;
+    if (vkstate.graphics_pipeline_library)
+    {
+        REXINFO("Using graphics pipeline libraries");
+        device_extensions[device_ext_count++] = VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME;
+        device_extensions[device_ext_count++] = VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME;
+        library_features = (VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT){VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT};
+        library_features.graphicsPipelineLibrary = VK_TRUE;
+        library_features.pNext = enabled_features;
+        enabled_features = &library_features;
+    }
+    else
+    {
+        REXINFO("Graphics pipeline libraries not supported, using monolithic pipelines");
+    }
+
+    // Cull mode, front face, topology and depth state are core dynamic state since 1.3.
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkstate.physical_device, &properties);
+    if (vkstate.extended_dynamic_state && properties.apiVersion < VK_API_VERSION_1_3)
+    {
+        REXINFO("Extended dynamic state needs Vulkan 1.3, baking the state into pipelines");
+        vkstate.extended_dynamic_state = false;
+    }
+
+    vkstate.dynamic_blend_enable = vkstate.extended_dynamic_state && dynamic_state3_features.extendedDynamicState3ColorBlendEnable;
+    if (vkstate.dynamic_blend_enable)
+    {
+        device_extensions[device_ext_count++] = VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME;
+        dynamic_state3_features = (VkPhysicalDeviceExtendedDynamicState3FeaturesEXT){VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT};
+        dynamic_state3_features.extendedDynamicState3ColorBlendEnable = VK_TRUE;
+        dynamic_state3_features.pNext = enabled_features;
+        enabled_features = &dynamic_state3_features;
+    }
+
+    b8 calibrated_timestamps = profiler_enabled() && supports_calibrated_timestamps(available_extensions, available_ext_count);
+    if (calibrated_timestamps)
+    {
+        device_extensions[device_ext_count++] = VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
+    }
+    else if (profiler_enabled())
+    {
+        REXWARN("Calibrated timestamps not supported, the trace has no GPU track");
+    }
 
     VkDeviceCreateInfo device_info = {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
+    device_info.pNext = enabled_features;
     device_info.queueCreateInfoCount = queue_count;
     device_info.pQueueCreateInfos = queue_info;
     device_info.pEnabledFeatures = &device_features;
-    device_info.enabledExtensionCount = 1;
-    device_info.ppEnabledExtensionNames = &swapchain_ext;
+    device_info.enabledExtensionCount = device_ext_count;
+    device_info.ppEnabledExtensionNames = device_extensions;
 
-    if (vkCreateDevice(vkstate.physical_device, &device_info, 0, &vkstate.device) != VK_SUCCESS)
+    if (vkCreateDevice(vkstate.physical_device, &device_info, vkstate.allocator, &vkstate.device) != VK_SUCCESS)
     {
         REXFATAL("failed to create logical device!");
         return false;
@@ -430,13 +835,176 @@ b8 create_logical_device()
     vkGetDeviceQueue(vkstate.device, vkstate.compute_queue_index.family_index, vkstate.graphics_queue_index.index, &vkstate.compute_queue);
     vkGetDeviceQueue(vkstate.device, vkstate.transfer_queue_index.family_index, vkstate.graphics_queue_index.index, &vkstate.transfer_queue);
 
+    if (vkstate.dynamic_blend_enable)
+        vkstate.cmd_set_color_blend_enable = (PFN_vkCmdSetColorBlendEnableEXT)vkGetDeviceProcAddr(vkstate.device, "vkCmdSetColorBlendEnableEXT");
+    if (calibrated_timestamps)
+        vkstate.get_calibrated_timestamps = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(vkstate.device, "vkGetCalibratedTimestampsEXT");
+
+    return true;
+}
+
+b8 create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect, VkImageView *out_view)
+{
+    VkImageViewCreateInfo image_view_info = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+    image_view_info.image = image;
+    image_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    image_view_info.format = format;
+    image_view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    image_view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    image_view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    image_view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    image_view_info.subresourceRange.aspectMask = aspect;
+    image_view_info.subresourceRange.baseMipLevel = 0;
+    image_view_info.subresourceRange.levelCount = 1;
+    image_view_info.subresourceRange.baseArrayLayer = 0;
+    image_view_info.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(vkstate.device, &image_view_info, vkstate.allocator, out_view) != VK_SUCCESS)
+    {
+        REXFATAL("failed to create image views!");
+        return false;
+    }
+
+    return true;
+}
+
+b8 find_memory_type(u32 type_bits, VkMemoryPropertyFlags properties, u32 *out_type_index)
+{
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(vkstate.physical_device, &memory_properties);
+
+    for (u32 i = 0; i < memory_properties.memoryTypeCount; i++)
+    {
+        if ((type_bits & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            *out_type_index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+b8 allocate_memory(VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, VkDeviceMemory *out_memory)
+{
+    VkMemoryAllocateInfo allocate_info = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+    allocate_info.allocationSize = requirements.size;
+    if (!find_memory_type(requirements.memoryTypeBits, properties, &allocate_info.memoryTypeIndex))
+        return false;
+
+    return vkAllocateMemory(vkstate.device, &allocate_info, vkstate.allocator, out_memory) == VK_SUCCESS;
+}
+
+// Stands in for the swapchain when presenting in software: images the frames are rendered to,
+// each with a host visible buffer its pixels are copied into.
+b8 create_software_targets()
+{
+    REXDEBUG("Creating offscreen targets...");
+
+    // Same byte order as the XRGB8888 buffers of the window.
+    vkstate.image_format.format = VK_FORMAT_B8G8R8A8_SRGB;
+    vkstate.image_format.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    vkstate.image_count = SOFTWARE_FRAME_COUNT;
+    vkstate.swapchain_images = rexallocate(sizeof(VkImage) * vkstate.image_count, MEMORY_TAG_RENDERER);
+    vkstate.swapchain_image_views = rexallocate(sizeof(VkImageView) * vkstate.image_count, MEMORY_TAG_RENDERER);
+
+    for (u32 i = 0; i < vkstate.image_count; i++)
+    {
+        SoftwareFrame *frame = &vkstate.software_frames[i];
+
+        VkImageCreateInfo image_info = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = vkstate.image_format.format;
+        image_info.extent.width = vkstate.framebuffer_width;
+        image_info.extent.height = vkstate.framebuffer_height;
+        image_info.extent.depth = 1;
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (vkCreateImage(vkstate.device, &image_info, vkstate.allocator, &vkstate.swapchain_images[i]) != VK_SUCCESS)
+        {
+            REXFATAL("failed to create offscreen image!");
+            return false;
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(vkstate.device, vkstate.swapchain_images[i], &requirements);
+        if (!allocate_memory(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame->image_memory))
+        {
+            REXFATAL("failed to allocate offscreen image memory!");
+            return false;
+        }
+        vkBindImageMemory(vkstate.device, vkstate.swapchain_images[i], frame->image_memory, 0);
+
+        if (!create_image_view(vkstate.swapchain_images[i], vkstate.image_format.format, VK_IMAGE_ASPECT_COLOR_BIT, &vkstate.swapchain_image_views[i]))
+            return false;
+
+        VkBufferCreateInfo buffer_info = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        buffer_info.size = (VkDeviceSize)vkstate.framebuffer_width * vkstate.framebuffer_height * 4;
+        buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(vkstate.device, &buffer_info, vkstate.allocator, &frame->readback_buffer) != VK_SUCCESS)
+        {
+            REXFATAL("failed to create readback buffer!");
+            return false;
+        }
+
+        // The CPU reads every pixel back, cached memory makes that a lot faster where it exists.
+        vkGetBufferMemoryRequirements(vkstate.device, frame->readback_buffer, &requirements);
+        VkMemoryPropertyFlags host_memory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        if (!allocate_memory(requirements, host_memory | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &frame->readback_memory) &&
+            !allocate_memory(requirements, host_memory, &frame->readback_memory))
+        {
+            REXFATAL("failed to allocate readback memory!");
+            return false;
+        }
+        vkBindBufferMemory(vkstate.device, frame->readback_buffer, frame->readback_memory, 0);
+        vkMapMemory(vkstate.device, frame->readback_memory, 0, VK_WHOLE_SIZE, 0, &frame->readback_data);
+    }
+
+    if (!vkstate.headless &&
+        !platform_create_software_buffers(&window, vkstate.framebuffer_width, vkstate.framebuffer_height, SOFTWARE_FRAME_COUNT))
+    {
+        REXFATAL("no way to present frames to the window!");
+        return false;
+    }
+
     return true;
 }
 
+const char *present_mode_name(VkPresentModeKHR present_mode)
+{
+    switch (present_mode)
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "fifo_relaxed";
+    default:
+        return "unknown";
+    }
+}
+
 b8 create_swapchain()
 {
+    PROFILE_FUNCTION();
+    if (vkstate.software_present)
+        return create_software_targets();
+
     REXDEBUG("Creating swpachain...");
 
+    // The surface limits change with the window.
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vkstate.physical_device, vkstate.surface, &vkstate.swapchain_support.capabilities);
+
     u32 format_index = 0;
     for (u32 i = 0; i < vkstate.swapchain_support.format_count; i++)
     {
@@ -447,16 +1015,20 @@ b8 create_swapchain()
         }
     }
 
-    u32 present_mode_index = -1;
-    // IF DON'T FIND, USE VK_PRESENT_MODE_FIFO_KHR
+    // FIFO is the only mode that is always supported.
+    vkstate.present_mode = VK_PRESENT_MODE_FIFO_KHR;
     for (u32 i = 0; i < vkstate.swapchain_support.present_mode_count; i++)
     {
-        if (vkstate.swapchain_support.present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
+        if (vkstate.swapchain_support.present_modes[i] == vkstate.preferred_present_mode)
         {
-            present_mode_index = i;
+            vkstate.present_mode = vkstate.preferred_present_mode;
             break;
         }
     }
+    if (vkstate.present_mode != vkstate.preferred_present_mode)
+    {
+        REXINFO("%s present mode not supported, using fifo", present_mode_name(vkstate.preferred_present_mode));
+    }
 
     VkExtent2D min = vkstate.swapchain_support.capabilities.minImageExtent;
     VkExtent2D max = vkstate.swapchain_support.capabilities.maxImageExtent;
@@ -480,11 +1052,9 @@ b8 create_swapchain()
     swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
     swapchain_info.preTransform = vkstate.swapchain_support.capabilities.currentTransform;
     swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    if (present_mode_index == -1)
-        swapchain_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-    else
-        swapchain_info.presentMode = vkstate.swapchain_support.present_modes[present_mode_index];
+    swapchain_info.presentMode = vkstate.present_mode;
     swapchain_info.clipped = VK_TRUE;
+    swapchain_info.oldSwapchain = vkstate.swapchain;
 
     if (vkstate.graphics_queue_index.family_index != vkstate.present_queue_index.family_index)
     {
@@ -503,42 +1073,46 @@ b8 create_swapchain()
         swapchain_info.pQueueFamilyIndices = 0;
     }
 
-    vkCreateSwapchainKHR(vkstate.device, &swapchain_info, 0, &vkstate.swapchain);
+    VkSwapchainKHR new_swapchain = VK_NULL_HANDLE;
+    VkResult result = vkCreateSwapchainKHR(vkstate.device, &swapchain_info, vkstate.allocator, &new_swapchain);
 
-    if (vkstate.swapchain == VK_NULL_HANDLE)
+    // The old swapchain is retired either way.
+    vkDestroySwapchainKHR(vkstate.device, vkstate.swapchain, vkstate.allocator);
+    vkstate.swapchain = new_swapchain;
+
+    if (result != VK_SUCCESS)
         return false;
 
+    // The surface may not allow the size asked for.
+    vkstate.framebuffer_width = width;
+    vkstate.framebuffer_height = height;
+
     vkstate.image_format = vkstate.swapchain_support.formats[format_index];
 
     REXDEBUG("Retrieving the swapchain images...");
 
     vkGetSwapchainImagesKHR(vkstate.device, vkstate.swapchain, &vkstate.image_count, 0);
-    vkstate.swapchain_images = malloc(sizeof(VkImage) * vkstate.image_count);
+    vkstate.swapchain_images = rexallocate(sizeof(VkImage) * vkstate.image_count, MEMORY_TAG_RENDERER);
     vkGetSwapchainImagesKHR(vkstate.device, vkstate.swapchain, &vkstate.image_count, vkstate.swapchain_images);
 
     REXDEBUG("Creating image viwes...");
 
-    vkstate.swapchain_image_views = malloc(sizeof(VkImageView) * vkstate.image_count);
+    vkstate.swapchain_image_views = rexallocate(sizeof(VkImageView) * vkstate.image_count, MEMORY_TAG_RENDERER);
+
+    for (u32 i = 0; i < vkstate.image_count; i++)
+    {
+        if (!create_image_view(vkstate.swapchain_images[i], vkstate.image_format.format, VK_IMAGE_ASPECT_COLOR_BIT, &vkstate.swapchain_image_views[i]))
+            return false;
+    }
 
+    VkSemaphoreCreateInfo semaphore_info = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    vkstate.render_finished_semaphores = rexallocate(sizeof(VkSemaphore) * vkstate.image_count, MEMORY_TAG_RENDERER);
+    memset(vkstate.render_finished_semaphores, 0, sizeof(VkSemaphore) * vkstate.image_count);
     for (u32 i = 0; i < vkstate.image_count; i++)
     {
-        VkImageViewCreateInfo image_view_info = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
-        image_view_info.image = vkstate.swapchain_images[i];
-        image_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        image_view_info.format = vkstate.image_format.format;
-        image_view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        image_view_info.subresourceRange.baseMipLevel = 0;
-        image_view_info.subresourceRange.levelCount = 1;
-        image_view_info.subresourceRange.baseArrayLayer = 0;
-        image_view_info.subresourceRange.layerCount = 1;
-
-        if (vkCreateImageView(vkstate.device, &image_view_info, 0, &vkstate.swapchain_image_views[i]) != VK_SUCCESS)
+        if (vkCreateSemaphore(vkstate.device, &semaphore_info, vkstate.allocator, &vkstate.render_finished_semaphores[i]) != VK_SUCCESS)
         {
-            REXFATAL("failed to create image views!");
+            REXFATAL("failed to create sync objects!");
             return false;
         }
     }
@@ -548,44 +1122,94 @@ b8 create_swapchain()
 
 b8 create_render_pass()
 {
+    PROFILE_FUNCTION();
     REXDEBUG("Creating renderpass...");
 
-    VkAttachmentDescription color_attachment = {0};
-    color_attachment.format = vkstate.image_format.format;
-    color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    b8 msaa = vkstate.msaa_samples > VK_SAMPLE_COUNT_1_BIT;
+
+    // Attachment 0 is what the subpass draws to and 1 the depth buffer, with MSAA attachment 2
+    // is the image it's resolved into.
+    VkAttachmentDescription attachments[3] = {0};
+    VkAttachmentDescription *color_attachment = &attachments[0];
+    color_attachment->format = vkstate.image_format.format;
+    color_attachment->samples = vkstate.msaa_samples;
+    color_attachment->loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    color_attachment->storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color_attachment->stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    color_attachment->stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    color_attachment->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Software presentation copies the image to a buffer right after the render pass.
+    color_attachment->finalLayout = vkstate.software_present ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference color_attachment_ref = {0};
     color_attachment_ref.attachment = 0;
     color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    // Only needed while drawing.
+    VkAttachmentDescription *depth_attachment = &attachments[1];
+    depth_attachment->format = vkstate.depth_format;
+    depth_attachment->samples = vkstate.msaa_samples;
+    depth_attachment->loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment->storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment->stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depth_attachment->stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depth_attachment->finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depth_attachment_ref = {0};
+    depth_attachment_ref.attachment = 1;
+    depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference resolve_attachment_ref = {0};
+    resolve_attachment_ref.attachment = 2;
+    resolve_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    if (msaa)
+    {
+        // Only the resolved samples are kept.
+        attachments[2] = *color_attachment;
+        attachments[2].samples = VK_SAMPLE_COUNT_1_BIT;
+        attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        color_attachment->storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        color_attachment->finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+
     VkSubpassDescription subpass = {0};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &color_attachment_ref;
-
-    VkSubpassDependency dependency = {0};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    subpass.pResolveAttachments = msaa ? &resolve_attachment_ref : 0;
+    subpass.pDepthStencilAttachment = &depth_attachment_ref;
+
+    VkSubpassDependency dependencies[2] = {0};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    // The depth and multisampled images are shared by every frame, the previous one has to be
+    // done with them.
+    dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    if (msaa)
+        dependencies[0].srcAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // The readback copy waits for the color writes.
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
     VkRenderPassCreateInfo render_pass_info = {VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
-    render_pass_info.attachmentCount = 1;
-    render_pass_info.pAttachments = &color_attachment;
+    render_pass_info.attachmentCount = msaa ? 3 : 2;
+    render_pass_info.pAttachments = attachments;
     render_pass_info.subpassCount = 1;
     render_pass_info.pSubpasses = &subpass;
-    render_pass_info.dependencyCount = 1;
-    render_pass_info.pDependencies = &dependency;
+    render_pass_info.dependencyCount = vkstate.software_present ? 2 : 1;
+    render_pass_info.pDependencies = dependencies;
 
-    if (vkCreateRenderPass(vkstate.device, &render_pass_info, 0, &vkstate.render_pass) != VK_SUCCESS)
+    if (vkCreateRenderPass(vkstate.device, &render_pass_info, vkstate.allocator, &vkstate.render_pass) != VK_SUCCESS)
     {
         REXFATAL("failed to create renderpass!");
         return false;
@@ -627,169 +1251,824 @@ b8 create_shader_module(u8 *buffer, u32 buffer_size, VkShaderModule *out_shader)
     shader_info.codeSize = buffer_size;
     shader_info.pCode = (u32 *)buffer;
 
-    if (vkCreateShaderModule(vkstate.device, &shader_info, 0, out_shader) != VK_SUCCESS)
+    if (vkCreateShaderModule(vkstate.device, &shader_info, vkstate.allocator, out_shader) != VK_SUCCESS)
         return false;
     return true;
 }
 
-b8 create_graphics_pipeline()
+void pipeline_desc_init(PipelineDesc *out_desc, const char *vert_shader_name, const char *frag_shader_name)
 {
-    REXDEBUG("Creating graphics pipeline...");
+    memset(out_desc, 0, sizeof(PipelineDesc));
+    strncpy(out_desc->vert_shader_name, vert_shader_name, PIPELINE_SHADER_NAME_LENGTH - 1);
+    strncpy(out_desc->frag_shader_name, frag_shader_name, PIPELINE_SHADER_NAME_LENGTH - 1);
+    out_desc->topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    out_desc->cull_mode = VK_CULL_MODE_BACK_BIT;
+    out_desc->front_face = VK_FRONT_FACE_CLOCKWISE;
+    out_desc->depth_compare_op = VK_COMPARE_OP_LESS_OR_EQUAL;
+    out_desc->blend_enable = VK_TRUE;
+}
 
-    u32 vert_shader_buffer_size;
-    if (!read_file("shader/triangle.vert.spv", &vert_shader_buffer_size, 0))
-        return false;
-    u8 *vert_shader_buffer = malloc(vert_shader_buffer_size);
-    if (!read_file("shader/triangle.vert.spv", &vert_shader_buffer_size, vert_shader_buffer))
+b8 pipeline_desc_set_constant(PipelineDesc *desc, u32 constant_id, u32 value)
+{
+    // Kept sorted, so setting the same constants in any order gives the same hash.
+    u32 i = 0;
+    while (i < desc->spec_constant_count && desc->spec_constant_ids[i] < constant_id)
+        i++;
+
+    if (i < desc->spec_constant_count && desc->spec_constant_ids[i] == constant_id)
+    {
+        desc->spec_constant_values[i] = value;
+        return true;
+    }
+
+    if (desc->spec_constant_count == PIPELINE_MAX_SPEC_CONSTANTS)
+    {
+        REXERROR("too many specialization constants, max is %i", PIPELINE_MAX_SPEC_CONSTANTS);
         return false;
+    }
+
+    memmove(&desc->spec_constant_ids[i + 1], &desc->spec_constant_ids[i], (desc->spec_constant_count - i) * sizeof(u32));
+    memmove(&desc->spec_constant_values[i + 1], &desc->spec_constant_values[i], (desc->spec_constant_count - i) * sizeof(u32));
+    desc->spec_constant_ids[i] = constant_id;
+    desc->spec_constant_values[i] = value;
+    desc->spec_constant_count++;
+    return true;
+}
+
+u64 pipeline_desc_hash(const PipelineDesc *desc)
+{
+    return rexhash_bytes(desc, sizeof(PipelineDesc), 0);
+}
+
+// Clears the fields that are dynamic state, so descs that only differ there share a pipeline.
+void pipeline_desc_static_part(const PipelineDesc *desc, PipelineDesc *out_desc)
+{
+    *out_desc = *desc;
+    if (!vkstate.extended_dynamic_state)
+        return;
+
+    // Only the topology class has to match the pipeline.
+    switch (desc->topology)
+    {
+    case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+        break;
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+        out_desc->topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+        break;
+    case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+        break;
+    default:
+        out_desc->topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        break;
+    }
+
+    out_desc->cull_mode = 0;
+    out_desc->front_face = 0;
+    out_desc->depth_test_enable = 0;
+    out_desc->depth_write_enable = 0;
+    out_desc->depth_compare_op = 0;
+    if (vkstate.dynamic_blend_enable)
+        out_desc->blend_enable = 0;
+}
+
+void set_dynamic_pipeline_state(VkCommandBuffer command_buffer, const PipelineDesc *desc)
+{
+    vkCmdSetPrimitiveTopology(command_buffer, desc->topology);
+    vkCmdSetCullMode(command_buffer, desc->cull_mode);
+    vkCmdSetFrontFace(command_buffer, desc->front_face);
+    vkCmdSetDepthTestEnable(command_buffer, desc->depth_test_enable);
+    vkCmdSetDepthWriteEnable(command_buffer, desc->depth_write_enable);
+    vkCmdSetDepthCompareOp(command_buffer, desc->depth_compare_op);
+
+    if (vkstate.dynamic_blend_enable)
+    {
+        VkBool32 blend_enable = desc->blend_enable;
+        vkstate.cmd_set_color_blend_enable(command_buffer, 0, 1, &blend_enable);
+    }
+}
 
-    u32 frag_shader_buffer_size;
-    if (!read_file("shader/triangle.frag.spv", &frag_shader_buffer_size, 0))
+b8 load_shader_module(const char *shader_name, VkShaderModule *out_shader)
+{
+    char shader_path[256];
+    snprintf(shader_path, sizeof(shader_path), "shader/%s.spv", shader_name);
+
+    u32 shader_buffer_size;
+    if (!read_file(shader_path, &shader_buffer_size, 0))
         return false;
-    u8 *frag_shader_buffer = malloc(frag_shader_buffer_size);
-    if (!read_file("shader/triangle.frag.spv", &frag_shader_buffer_size, frag_shader_buffer))
+    u8 *shader_buffer = rexallocate(shader_buffer_size, MEMORY_TAG_RENDERER);
+    if (!read_file(shader_path, &shader_buffer_size, shader_buffer))
+    {
+        rexfree(shader_buffer);
         return false;
+    }
+
+    b8 result = create_shader_module(shader_buffer, shader_buffer_size, out_shader);
+    rexfree(shader_buffer);
+    if (!result)
+        REXERROR("failed to create shader module [%s]!", shader_name);
+    return result;
+}
+
+// Fixed function state of a pipeline, filled from a PipelineDesc. Must not be moved once
+// filled, the create infos point into it.
+typedef struct PipelineStates
+{
+    VkSpecializationMapEntry spec_entries[PIPELINE_MAX_SPEC_CONSTANTS];
+    VkSpecializationInfo spec_info;
+    VkDynamicState dynamic_states[9];
+    VkPipelineDynamicStateCreateInfo dynamic_state_info;
+    VkPipelineVertexInputStateCreateInfo vertex_input_info;
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_info;
+    VkPipelineViewportStateCreateInfo viewport_state_info;
+    VkPipelineRasterizationStateCreateInfo rasterizer_info;
+    VkPipelineMultisampleStateCreateInfo multisampling_info;
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_info;
+    VkPipelineColorBlendAttachmentState color_blend_attachment;
+    VkPipelineColorBlendStateCreateInfo color_blending_info;
+} PipelineStates;
+
+void fill_pipeline_states(const PipelineDesc *desc, PipelineStates *out_states)
+{
+    memset(out_states, 0, sizeof(PipelineStates));
+
+    // Both stages get the same constants, a stage ignores the ids it doesn't declare.
+    for (u32 i = 0; i < desc->spec_constant_count; i++)
+    {
+        out_states->spec_entries[i].constantID = desc->spec_constant_ids[i];
+        out_states->spec_entries[i].offset = i * sizeof(u32);
+        out_states->spec_entries[i].size = sizeof(u32);
+    }
+    out_states->spec_info.mapEntryCount = desc->spec_constant_count;
+    out_states->spec_info.pMapEntries = out_states->spec_entries;
+    out_states->spec_info.dataSize = desc->spec_constant_count * sizeof(u32);
+    out_states->spec_info.pData = desc->spec_constant_values;
+
+    u32 dynamic_state_count = 0;
+    out_states->dynamic_states[dynamic_state_count++] = VK_DYNAMIC_STATE_VIEWPORT;
+    out_states->dynamic_states[dynamic_state_count++] = VK_DYNAMIC_STATE_SCISSOR;
+    if (vkstate.extended_dynamic_state)
+    {
+        out_states->dynamic_states[dynamic_state_count++] = VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY;
+        out_states->dynamic_states[dynamic_state_count++] = VK_DYNAMIC_STATE_CULL_MODE;
+        out_states->dynamic_states[dynamic_state_count++] = VK_DYNAMIC_STATE_FRONT_FACE;
+        out_states->dynamic_states[dynamic_state_count++] = VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE;
+        out_states->dynamic_states[dynamic_state_count++] = VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE;
+        out_states->dynamic_states[dynamic_state_count++] = VK_DYNAMIC_STATE_DEPTH_COMPARE_OP;
+    }
+    if (vkstate.dynamic_blend_enable)
+        out_states->dynamic_states[dynamic_state_count++] = VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT;
+    out_states->dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    out_states->dynamic_state_info.dynamicStateCount = dynamic_state_count;
+    out_states->dynamic_state_info.pDynamicStates = out_states->dynamic_states;
+
+    out_states->vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    out_states->input_assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    out_states->input_assembly_info.topology = desc->topology;
+    out_states->input_assembly_info.primitiveRestartEnable = VK_FALSE;
+
+    // Viewport and scissor are dynamic, set in record_command_buffer.
+    out_states->viewport_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    out_states->viewport_state_info.viewportCount = 1;
+    out_states->viewport_state_info.scissorCount = 1;
+
+    out_states->rasterizer_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    out_states->rasterizer_info.depthClampEnable = VK_FALSE;
+    out_states->rasterizer_info.rasterizerDiscardEnable = VK_FALSE;
+    out_states->rasterizer_info.polygonMode = VK_POLYGON_MODE_FILL;
+    out_states->rasterizer_info.lineWidth = 1.0f;
+    out_states->rasterizer_info.cullMode = desc->cull_mode;
+    out_states->rasterizer_info.frontFace = desc->front_face;
+    out_states->rasterizer_info.depthBiasEnable = VK_FALSE;
+
+    out_states->multisampling_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    out_states->multisampling_info.sampleShadingEnable = VK_FALSE;
+    out_states->multisampling_info.rasterizationSamples = vkstate.msaa_samples;
+
+    out_states->depth_stencil_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    out_states->depth_stencil_info.depthTestEnable = desc->depth_test_enable;
+    out_states->depth_stencil_info.depthWriteEnable = desc->depth_write_enable;
+    out_states->depth_stencil_info.depthCompareOp = desc->depth_compare_op;
+
+    out_states->color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    out_states->color_blend_attachment.blendEnable = desc->blend_enable;
+    out_states->color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    out_states->color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    out_states->color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    out_states->color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    out_states->color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    out_states->color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    out_states->color_blending_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    out_states->color_blending_info.logicOpEnable = VK_FALSE;
+    out_states->color_blending_info.logicOp = VK_LOGIC_OP_COPY; // Optional
+    out_states->color_blending_info.attachmentCount = 1;
+    out_states->color_blending_info.pAttachments = &out_states->color_blend_attachment;
+}
 
+b8 build_graphics_pipeline(const PipelineDesc *desc, VkPipeline *out_pipeline)
+{
+    PROFILE_FUNCTION();
     VkShaderModule vert_shader;
     VkShaderModule frag_shader;
-    if (!create_shader_module(vert_shader_buffer, vert_shader_buffer_size, &vert_shader))
-    {
-        REXFATAL("failed to create vertex shader module!");
+    if (!load_shader_module(desc->vert_shader_name, &vert_shader))
         return false;
-    }
-    if (!create_shader_module(frag_shader_buffer, frag_shader_buffer_size, &frag_shader))
+    if (!load_shader_module(desc->frag_shader_name, &frag_shader))
     {
-        REXFATAL("failed to create fragment shader module!");
+        vkDestroyShaderModule(vkstate.device, vert_shader, vkstate.allocator);
         return false;
     }
 
+    PipelineStates states;
+    fill_pipeline_states(desc, &states);
+
     VkPipelineShaderStageCreateInfo vert_shader_stage_info = {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
     vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
     vert_shader_stage_info.module = vert_shader;
     vert_shader_stage_info.pName = "main";
+    vert_shader_stage_info.pSpecializationInfo = desc->spec_constant_count ? &states.spec_info : 0;
 
     VkPipelineShaderStageCreateInfo frag_shader_stage_info = {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
     frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     frag_shader_stage_info.module = frag_shader;
     frag_shader_stage_info.pName = "main";
+    frag_shader_stage_info.pSpecializationInfo = desc->spec_constant_count ? &states.spec_info : 0;
 
     VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info, frag_shader_stage_info};
 
-    VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-
-    VkPipelineDynamicStateCreateInfo dynamic_state_info = {VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO};
-    dynamic_state_info.dynamicStateCount = 2;
-    dynamic_state_info.pDynamicStates = dynamic_states;
-
-    VkPipelineVertexInputStateCreateInfo vertex_input_info = {VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
-
-    VkPipelineInputAssemblyStateCreateInfo input_assembly_info = {VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO};
-    input_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    input_assembly_info.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport = {0};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (f32)vkstate.framebuffer_width;
-    viewport.height = (f32)vkstate.framebuffer_height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor = {0};
-    scissor.offset = (VkOffset2D){0, 0};
-    scissor.extent.width = vkstate.framebuffer_width;
-    scissor.extent.width = vkstate.framebuffer_height;
-
-    VkPipelineViewportStateCreateInfo viewport_state_info = {VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO};
-    viewport_state_info.viewportCount = 1;
-    viewport_state_info.pViewports = &viewport;
-    viewport_state_info.scissorCount = 1;
-    viewport_state_info.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer_info = {VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO};
-    rasterizer_info.depthClampEnable = VK_FALSE;
-    rasterizer_info.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer_info.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer_info.lineWidth = 1.0f;
-    rasterizer_info.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer_info.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizer_info.depthBiasEnable = VK_FALSE;
-
-    VkPipelineMultisampleStateCreateInfo multisampling_info = {VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO};
-    multisampling_info.sampleShadingEnable = VK_FALSE;
-    multisampling_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-    VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
-    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    color_blend_attachment.blendEnable = VK_TRUE;
-    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
-    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-    VkPipelineColorBlendStateCreateInfo color_blending_info = {VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO};
-    color_blending_info.logicOpEnable = VK_FALSE;
-    color_blending_info.logicOp = VK_LOGIC_OP_COPY; // Optional
-    color_blending_info.attachmentCount = 1;
-    color_blending_info.pAttachments = &color_blend_attachment;
-
-    VkPipelineLayoutCreateInfo pipeline_layout_info = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-
-    if (vkCreatePipelineLayout(vkstate.device, &pipeline_layout_info, 0, &vkstate.pipeline_layout) != VK_SUCCESS)
-    {
-        REXFATAL("failed to create pipeline layout!");
-        return false;
-    }
-
     VkGraphicsPipelineCreateInfo pipeline_info = {VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
     pipeline_info.stageCount = 2;
     pipeline_info.pStages = shader_stages;
-    pipeline_info.pVertexInputState = &vertex_input_info;
-    pipeline_info.pInputAssemblyState = &input_assembly_info;
-    pipeline_info.pViewportState = &viewport_state_info;
-    pipeline_info.pRasterizationState = &rasterizer_info;
-    pipeline_info.pMultisampleState = &multisampling_info;
-    pipeline_info.pDepthStencilState = 0; // Optional
-    pipeline_info.pColorBlendState = &color_blending_info;
-    pipeline_info.pDynamicState = &dynamic_state_info;
+    pipeline_info.pVertexInputState = &states.vertex_input_info;
+    pipeline_info.pInputAssemblyState = &states.input_assembly_info;
+    pipeline_info.pViewportState = &states.viewport_state_info;
+    pipeline_info.pRasterizationState = &states.rasterizer_info;
+    pipeline_info.pMultisampleState = &states.multisampling_info;
+    pipeline_info.pDepthStencilState = &states.depth_stencil_info;
+    pipeline_info.pColorBlendState = &states.color_blending_info;
+    pipeline_info.pDynamicState = &states.dynamic_state_info;
     pipeline_info.layout = vkstate.pipeline_layout;
     pipeline_info.renderPass = vkstate.render_pass;
     pipeline_info.subpass = 0;
 
-    if (vkCreateGraphicsPipelines(vkstate.device, 0, 1, &pipeline_info, 0, &vkstate.graphics_pipeline) != VK_SUCCESS)
-    {
-        REXFATAL("failed to create graphics pipeline!");
-        return false;
-    }
+    VkResult result = vkCreateGraphicsPipelines(vkstate.device, vkstate.pipeline_cache, 1, &pipeline_info, vkstate.allocator, out_pipeline);
+
+    vkDestroyShaderModule(vkstate.device, vert_shader, vkstate.allocator);
+    vkDestroyShaderModule(vkstate.device, frag_shader, vkstate.allocator);
+    return result == VK_SUCCESS;
+}
+
+// Keeps only the fields of the desc that affect one library part, so descs that differ
+// elsewhere share the part.
+void pipeline_desc_library_part(const PipelineDesc *desc, VkGraphicsPipelineLibraryFlagsEXT part, PipelineDesc *out_desc)
+{
+    memset(out_desc, 0, sizeof(PipelineDesc));
+    switch (part)
+    {
+    case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+        out_desc->topology = desc->topology;
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+        memcpy(out_desc->vert_shader_name, desc->vert_shader_name, PIPELINE_SHADER_NAME_LENGTH);
+        out_desc->cull_mode = desc->cull_mode;
+        out_desc->front_face = desc->front_face;
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+        memcpy(out_desc->frag_shader_name, desc->frag_shader_name, PIPELINE_SHADER_NAME_LENGTH);
+        out_desc->depth_test_enable = desc->depth_test_enable;
+        out_desc->depth_write_enable = desc->depth_write_enable;
+        out_desc->depth_compare_op = desc->depth_compare_op;
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT:
+        out_desc->blend_enable = desc->blend_enable;
+        break;
+    default:
+        break;
+    }
+
+    if (part & (VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT))
+    {
+        out_desc->spec_constant_count = desc->spec_constant_count;
+        memcpy(out_desc->spec_constant_ids, desc->spec_constant_ids, sizeof(desc->spec_constant_ids));
+        memcpy(out_desc->spec_constant_values, desc->spec_constant_values, sizeof(desc->spec_constant_values));
+    }
+}
+
+b8 build_pipeline_library(const PipelineDesc *part_desc, VkGraphicsPipelineLibraryFlagsEXT part, VkPipeline *out_library)
+{
+    PROFILE_FUNCTION();
+    PipelineStates states;
+    fill_pipeline_states(part_desc, &states);
+
+    VkGraphicsPipelineLibraryCreateInfoEXT library_info = {VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT};
+    library_info.flags = part;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
+    pipeline_info.pNext = &library_info;
+    pipeline_info.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+    pipeline_info.pDynamicState = &states.dynamic_state_info;
+
+    VkShaderModule shader = VK_NULL_HANDLE;
+    VkPipelineShaderStageCreateInfo shader_stage_info = {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
+    shader_stage_info.pName = "main";
+    shader_stage_info.pSpecializationInfo = part_desc->spec_constant_count ? &states.spec_info : 0;
+
+    switch (part)
+    {
+    case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+        pipeline_info.pVertexInputState = &states.vertex_input_info;
+        pipeline_info.pInputAssemblyState = &states.input_assembly_info;
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+        if (!load_shader_module(part_desc->vert_shader_name, &shader))
+            return false;
+        shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        shader_stage_info.module = shader;
+        pipeline_info.stageCount = 1;
+        pipeline_info.pStages = &shader_stage_info;
+        pipeline_info.pViewportState = &states.viewport_state_info;
+        pipeline_info.pRasterizationState = &states.rasterizer_info;
+        pipeline_info.layout = vkstate.pipeline_layout;
+        pipeline_info.renderPass = vkstate.render_pass;
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+        if (!load_shader_module(part_desc->frag_shader_name, &shader))
+            return false;
+        shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        shader_stage_info.module = shader;
+        pipeline_info.stageCount = 1;
+        pipeline_info.pStages = &shader_stage_info;
+        pipeline_info.pMultisampleState = &states.multisampling_info;
+        pipeline_info.pDepthStencilState = &states.depth_stencil_info;
+        pipeline_info.layout = vkstate.pipeline_layout;
+        pipeline_info.renderPass = vkstate.render_pass;
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT:
+        pipeline_info.pMultisampleState = &states.multisampling_info;
+        pipeline_info.pColorBlendState = &states.color_blending_info;
+        pipeline_info.renderPass = vkstate.render_pass;
+        break;
+    default:
+        return false;
+    }
+
+    VkResult result = vkCreateGraphicsPipelines(vkstate.device, vkstate.pipeline_cache, 1, &pipeline_info, vkstate.allocator, out_library);
+
+    if (shader != VK_NULL_HANDLE)
+        vkDestroyShaderModule(vkstate.device, shader, vkstate.allocator);
+    return result == VK_SUCCESS;
+}
+
+// Thread safe, called from the compile jobs.
+VkPipeline get_pipeline_library(const PipelineDesc *desc, VkGraphicsPipelineLibraryFlagsEXT part)
+{
+    PipelineLibrary library;
+    pipeline_desc_library_part(desc, part, &library.desc);
+    library.part = part;
+
+    u64 key = rexhash_bytes(&part, sizeof(part), pipeline_desc_hash(&library.desc));
+
+    mtx_lock(&vkstate.pipeline_library_mutex);
+    PipelineLibrary *found;
+    while ((found = rexhashmap_get(&vkstate.pipeline_libraries, key)) && (found->part != part || memcmp(&found->desc, &library.desc, sizeof(PipelineDesc))))
+        key = rexhash_bytes(&key, sizeof(key), key);
+    VkPipeline result = found ? found->library : VK_NULL_HANDLE;
+    mtx_unlock(&vkstate.pipeline_library_mutex);
+
+    if (result != VK_NULL_HANDLE)
+        return result;
+
+    // Built without holding the lock, so other jobs keep linking in the meantime.
+    u32 generation = atomic_load(&vkstate.pipeline_library_generation);
+    if (!build_pipeline_library(&library.desc, part, &library.library))
+        return VK_NULL_HANDLE;
+
+    mtx_lock(&vkstate.pipeline_library_mutex);
+    found = rexhashmap_get(&vkstate.pipeline_libraries, key);
+    if (generation != atomic_load(&vkstate.pipeline_library_generation))
+    {
+        // A shader was reloaded while building, the library may use the old source.
+        rexarray_push(vkstate.retired_libraries, &library.library);
+        result = library.library;
+    }
+    else if (found && found->part == part && !memcmp(&found->desc, &library.desc, sizeof(PipelineDesc)))
+    {
+        // Another job built the same part first.
+        vkDestroyPipeline(vkstate.device, library.library, vkstate.allocator);
+        result = found->library;
+    }
+    else
+    {
+        while (rexhashmap_get(&vkstate.pipeline_libraries, key))
+            key = rexhash_bytes(&key, sizeof(key), key);
+        rexhashmap_insert(&vkstate.pipeline_libraries, key, &library);
+        result = library.library;
+    }
+    mtx_unlock(&vkstate.pipeline_library_mutex);
+
+    return result;
+}
+
+b8 link_graphics_pipeline(const PipelineDesc *desc, b8 optimize, VkPipeline *out_pipeline)
+{
+    PROFILE_FUNCTION();
+    VkPipeline libraries[4];
+    libraries[0] = get_pipeline_library(desc, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT);
+    libraries[1] = get_pipeline_library(desc, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+    libraries[2] = get_pipeline_library(desc, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+    libraries[3] = get_pipeline_library(desc, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT);
+
+    for (u32 i = 0; i < 4; i++)
+    {
+        if (libraries[i] == VK_NULL_HANDLE)
+            return false;
+    }
+
+    VkPipelineLibraryCreateInfoKHR linking_info = {VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR};
+    linking_info.libraryCount = 4;
+    linking_info.pLibraries = libraries;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
+    pipeline_info.pNext = &linking_info;
+    pipeline_info.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+    pipeline_info.layout = vkstate.pipeline_layout;
+
+    return vkCreateGraphicsPipelines(vkstate.device, vkstate.pipeline_cache, 1, &pipeline_info, vkstate.allocator, out_pipeline) == VK_SUCCESS;
+}
+
+void compile_pipeline_job(void *data)
+{
+    PROFILE_FUNCTION();
+    PipelineVariant *variant = data;
+
+    f64 start_time = platform_get_absolute_time();
+    if (vkstate.graphics_pipeline_library)
+        variant->compile_succeeded = link_graphics_pipeline(&variant->desc, variant->optimize, &variant->compiled);
+    else
+        variant->compile_succeeded = build_graphics_pipeline(&variant->desc, &variant->compiled);
+    variant->compile_time = platform_get_absolute_time() - start_time;
+
+    atomic_store_explicit(&variant->compile_state, PIPELINE_COMPILE_DONE, memory_order_release);
+
+    // The main thread swaps the pipeline in when it dispatches the event, or finds it with
+    // the next update if the event didn't fit.
+    EventContext context = {0};
+    if (!event_post_threadsafe(EVENT_CODE_PIPELINE_COMPILED, variant, context))
+        atomic_store_explicit(&vkstate.pipeline_events_dropped, true, memory_order_release);
+}
+
+void queue_pipeline_compile(PipelineVariant *variant, b8 optimize)
+{
+    variant->recompile = false;
+    variant->optimize = optimize;
+    variant->compiled = VK_NULL_HANDLE;
+    atomic_store_explicit(&variant->compile_state, PIPELINE_COMPILE_QUEUED, memory_order_relaxed);
+    vkstate.pipelines_compiling++;
+    jobs_submit(compile_pipeline_job, variant);
+}
+
+VkPipeline get_pipeline_variant(const PipelineDesc *full_desc)
+{
+    PipelineDesc static_desc;
+    pipeline_desc_static_part(full_desc, &static_desc);
+    const PipelineDesc *desc = &static_desc;
+
+    // On a hash collision keep rehashing until the matching desc or an empty slot is found.
+    u64 key = pipeline_desc_hash(desc);
+    PipelineVariant **slot;
+    while ((slot = rexhashmap_get(&vkstate.pipeline_variants, key)) && memcmp(&(*slot)->desc, desc, sizeof(PipelineDesc)))
+        key = rexhash_bytes(&key, sizeof(key), key);
+
+    if (slot)
+        return (*slot)->pipeline;
+
+    // Variants are heap allocated so compile jobs can keep pointers while the map grows.
+    PipelineVariant *variant = rexallocate(sizeof(PipelineVariant), MEMORY_TAG_RENDERER);
+    memset(variant, 0, sizeof(PipelineVariant));
+    variant->desc = *desc;
+    rexhashmap_insert(&vkstate.pipeline_variants, key, &variant);
+
+    if (vkstate.pipeline_variants.count == PIPELINE_VARIANT_BUDGET + 1)
+        REXWARN("more than %i pipeline variants created, check for unbounded permutations", PIPELINE_VARIANT_BUDGET);
+
+    queue_pipeline_compile(variant, false);
+    return VK_NULL_HANDLE;
+}
+
+// Puts the pipeline of a finished compile in use, on the main thread.
+void finish_pipeline_compile(PipelineVariant *variant)
+{
+    if (atomic_load_explicit(&variant->compile_state, memory_order_acquire) != PIPELINE_COMPILE_DONE)
+        return;
+
+    if (variant->compile_succeeded)
+    {
+        // The previous frame may still be using the old pipeline, it is destroyed after its fence.
+        if (variant->pipeline != VK_NULL_HANDLE)
+            rexarray_push(vkstate.retired_pipelines, &variant->pipeline);
+        variant->pipeline = variant->compiled;
+
+        const char *action = !vkstate.graphics_pipeline_library ? "Compiled" : variant->optimize ? "Optimized" : "Linked";
+        REXINFO("%s pipeline [%s, %s] in %.2f ms", action, variant->desc.vert_shader_name, variant->desc.frag_shader_name, variant->compile_time * 1000.0);
+    }
+    else
+    {
+        REXERROR("failed to compile pipeline [%s, %s]", variant->desc.vert_shader_name, variant->desc.frag_shader_name);
+    }
+
+    atomic_store_explicit(&variant->compile_state, PIPELINE_COMPILE_IDLE, memory_order_relaxed);
+    vkstate.pipelines_compiling--;
+
+    // A fast linked pipeline is swapped for an optimized one once that is ready.
+    if (variant->recompile)
+        queue_pipeline_compile(variant, false);
+    else if (variant->compile_succeeded && vkstate.graphics_pipeline_library && vkstate.optimize_linked_pipelines && !variant->optimize)
+        queue_pipeline_compile(variant, true);
+}
+
+b8 pipeline_compiled_event(u16 code, void *sender, EventContext data)
+{
+    finish_pipeline_compile((PipelineVariant *)sender);
+    return true;
+}
+
+// Compiles are finished through EVENT_CODE_PIPELINE_COMPILED, this picks up the ones whose
+// event was dropped and destroys retired libraries once nothing compiles.
+void update_pipeline_variants()
+{
+    if (!vkstate.pipelines_compiling)
+        return;
+
+    if (atomic_exchange_explicit(&vkstate.pipeline_events_dropped, false, memory_order_acquire))
+    {
+        for (u32 i = 0; i < vkstate.pipeline_variants.capacity; i++)
+        {
+            if (vkstate.pipeline_variants.keys[i] != 0)
+                finish_pipeline_compile(*(PipelineVariant **)rexhashmap_value_at(&vkstate.pipeline_variants, i));
+        }
+    }
+
+    if (!vkstate.pipelines_compiling && vkstate.graphics_pipeline_library)
+    {
+        // No job can be linking with a retired library anymore.
+        mtx_lock(&vkstate.pipeline_library_mutex);
+        u32 count = rexarray_len(vkstate.retired_libraries);
+        for (u32 i = 0; i < count; i++)
+            vkDestroyPipeline(vkstate.device, vkstate.retired_libraries[i], vkstate.allocator);
+        rexarray_clear(vkstate.retired_libraries);
+        mtx_unlock(&vkstate.pipeline_library_mutex);
+    }
+}
+
+b8 create_graphics_pipeline()
+{
+    PROFILE_FUNCTION();
+    REXDEBUG("Creating graphics pipeline...");
+
+    VkPushConstantRange push_constant_range = {0};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.size = sizeof(DrawConstants);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(vkstate.device, &pipeline_layout_info, vkstate.allocator, &vkstate.pipeline_layout) != VK_SUCCESS)
+    {
+        REXFATAL("failed to create pipeline layout!");
+        return false;
+    }
+
+    // Variants share compiled shader state through the pipeline cache. It is left internally
+    // synchronized so the compile jobs can use it at the same time.
+    VkPipelineCacheCreateInfo pipeline_cache_info = {VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+
+    if (vkCreatePipelineCache(vkstate.device, &pipeline_cache_info, vkstate.allocator, &vkstate.pipeline_cache) != VK_SUCCESS)
+    {
+        REXFATAL("failed to create pipeline cache!");
+        return false;
+    }
+
+    rexhashmap_create(sizeof(PipelineVariant *), 32, &vkstate.pipeline_variants);
+    vkstate.retired_pipelines = REXARRAY(VkPipeline);
+
+    mtx_init(&vkstate.pipeline_library_mutex, mtx_plain);
+    rexhashmap_create(sizeof(PipelineLibrary), 32, &vkstate.pipeline_libraries);
+    vkstate.retired_libraries = REXARRAY(VkPipeline);
+    vkstate.optimize_linked_pipelines = true;
+
+    // Only queued here, draws are skipped until the compile finished.
+    pipeline_desc_init(&vkstate.pipeline_desc, "triangle.vert", "triangle.frag");
+    vkstate.pipeline_desc.depth_test_enable = VK_TRUE;
+    vkstate.pipeline_desc.depth_write_enable = VK_TRUE;
+    get_pipeline_variant(&vkstate.pipeline_desc);
+
+    // The first style is the plain pipeline again and shares its variant.
+    for (u32 i = 0; i < SCENE_STYLE_COUNT; i++)
+        vkstate.scene_styles[i] = vkstate.pipeline_desc;
+    pipeline_desc_set_constant(&vkstate.scene_styles[1], SHADER_CONSTANT_GRAYSCALE, VK_TRUE);
+    pipeline_desc_set_constant(&vkstate.scene_styles[2], SHADER_CONSTANT_COLOR_LEVELS, 4);
+    // Flipping reverses the winding, the front face has to follow or it would be culled.
+    pipeline_desc_set_constant(&vkstate.scene_styles[3], SHADER_CONSTANT_GRAYSCALE, VK_TRUE);
+    pipeline_desc_set_constant(&vkstate.scene_styles[3], SHADER_CONSTANT_FLIP_Y, VK_TRUE);
+    vkstate.scene_styles[3].front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    if (vkstate.shader_variants)
+    {
+        for (u32 i = 0; i < SCENE_STYLE_COUNT; i++)
+            get_pipeline_variant(&vkstate.scene_styles[i]);
+        REXINFO("%i scene styles use %i pipeline variants", SCENE_STYLE_COUNT, vkstate.pipeline_variants.count);
+    }
 
-    vkDestroyShaderModule(vkstate.device, vert_shader, 0);
-    vkDestroyShaderModule(vkstate.device, frag_shader, 0);
-    free(vert_shader_buffer);
-    free(frag_shader_buffer);
     return true;
 }
 
+void evict_pipeline_libraries(const char *shader_name)
+{
+    mtx_lock(&vkstate.pipeline_library_mutex);
+
+    // Libraries still being built from the old source are not cached, see get_pipeline_library.
+    atomic_fetch_add(&vkstate.pipeline_library_generation, 1);
+
+    u64 *keys = REXARRAY(u64);
+    for (u32 i = 0; i < vkstate.pipeline_libraries.capacity; i++)
+    {
+        if (vkstate.pipeline_libraries.keys[i] == 0)
+            continue;
+
+        PipelineLibrary *library = rexhashmap_value_at(&vkstate.pipeline_libraries, i);
+        if (strcmp(shader_name, library->desc.vert_shader_name) && strcmp(shader_name, library->desc.frag_shader_name))
+            continue;
+
+        rexarray_push(vkstate.retired_libraries, &library->library);
+        rexarray_push(keys, &vkstate.pipeline_libraries.keys[i]);
+    }
+
+    for (u32 i = 0; i < rexarray_len(keys); i++)
+        rexhashmap_remove(&vkstate.pipeline_libraries, keys[i]);
+    rexarray_destroy(keys);
+
+    mtx_unlock(&vkstate.pipeline_library_mutex);
+}
+
+void reload_shader(const char *shader_name)
+{
+    PROFILE_FUNCTION();
+    if (vkstate.graphics_pipeline_library)
+        evict_pipeline_libraries(shader_name);
+
+    // Recompile only the variants that use the shader, the others stay untouched.
+    for (u32 i = 0; i < vkstate.pipeline_variants.capacity; i++)
+    {
+        if (vkstate.pipeline_variants.keys[i] == 0)
+            continue;
+
+        PipelineVariant *variant = *(PipelineVariant **)rexhashmap_value_at(&vkstate.pipeline_variants, i);
+        if (strcmp(shader_name, variant->desc.vert_shader_name) && strcmp(shader_name, variant->desc.frag_shader_name))
+            continue;
+
+        // Keeps drawing with the old pipeline until the new one is ready.
+        if (atomic_load_explicit(&variant->compile_state, memory_order_acquire) == PIPELINE_COMPILE_IDLE)
+            queue_pipeline_compile(variant, false);
+        else
+            variant->recompile = true;
+    }
+}
+
+void destroy_pipeline_variants()
+{
+    for (u32 i = 0; i < vkstate.pipeline_variants.capacity; i++)
+    {
+        if (vkstate.pipeline_variants.keys[i] == 0)
+            continue;
+
+        PipelineVariant *variant = *(PipelineVariant **)rexhashmap_value_at(&vkstate.pipeline_variants, i);
+        if (variant->pipeline != VK_NULL_HANDLE)
+            vkDestroyPipeline(vkstate.device, variant->pipeline, vkstate.allocator);
+        rexfree(variant);
+    }
+    rexhashmap_destroy(&vkstate.pipeline_variants);
+
+    for (u32 i = 0; i < vkstate.pipeline_libraries.capacity; i++)
+    {
+        if (vkstate.pipeline_libraries.keys[i] != 0)
+            vkDestroyPipeline(vkstate.device, ((PipelineLibrary *)rexhashmap_value_at(&vkstate.pipeline_libraries, i))->library, vkstate.allocator);
+    }
+    rexhashmap_destroy(&vkstate.pipeline_libraries);
+
+    for (u32 i = 0; i < rexarray_len(vkstate.retired_libraries); i++)
+        vkDestroyPipeline(vkstate.device, vkstate.retired_libraries[i], vkstate.allocator);
+    rexarray_destroy(vkstate.retired_libraries);
+    mtx_destroy(&vkstate.pipeline_library_mutex);
+}
+
+// Blocks until every queued compile finished and its pipeline is in use, including the
+// optimized relinks queued once fast linked pipelines are done.
+void wait_for_pipeline_compiles()
+{
+    while (vkstate.pipelines_compiling)
+    {
+        thrd_yield();
+        event_dispatch_queued();
+        update_pipeline_variants();
+    }
+}
+
+void destroy_retired_pipelines()
+{
+    u32 count = rexarray_len(vkstate.retired_pipelines);
+    for (u32 i = 0; i < count; i++)
+        vkDestroyPipeline(vkstate.device, vkstate.retired_pipelines[i], vkstate.allocator);
+    rexarray_clear(vkstate.retired_pipelines);
+}
+
+// Attachment that only lives during the render pass: it's cleared when the pass begins and its
+// contents are dropped at the end.
+b8 create_transient_attachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                               VkImage *out_image, VkDeviceMemory *out_memory, VkImageView *out_view)
+{
+    VkImageCreateInfo image_info = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = format;
+    image_info.extent.width = vkstate.framebuffer_width;
+    image_info.extent.height = vkstate.framebuffer_height;
+    image_info.extent.depth = 1;
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = vkstate.msaa_samples;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(vkstate.device, &image_info, vkstate.allocator, out_image) != VK_SUCCESS)
+    {
+        REXFATAL("failed to create attachment image!");
+        return false;
+    }
+
+    // Lazily allocated memory is only backed if the image ever leaves tile memory, which
+    // DONT_CARE stores avoid. Desktop GPUs don't have it.
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(vkstate.device, *out_image, &requirements);
+    if (!allocate_memory(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, out_memory) &&
+        !allocate_memory(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, out_memory))
+    {
+        REXFATAL("failed to allocate attachment memory!");
+        return false;
+    }
+    vkBindImageMemory(vkstate.device, *out_image, *out_memory, 0);
+
+    return create_image_view(*out_image, format, aspect, out_view);
+}
+
+// Depth buffer and, with MSAA, the multisampled color target. One of each is shared by all
+// swapchain images.
+b8 create_render_targets()
+{
+    PROFILE_FUNCTION();
+    REXDEBUG("Creating render targets...");
+
+    if (vkstate.msaa_samples > VK_SAMPLE_COUNT_1_BIT &&
+        !create_transient_attachment(vkstate.image_format.format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+                                     &vkstate.msaa_image, &vkstate.msaa_memory, &vkstate.msaa_view))
+        return false;
+
+    return create_transient_attachment(vkstate.depth_format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+                                       &vkstate.depth_image, &vkstate.depth_memory, &vkstate.depth_view);
+}
+
 b8 create_framebuffers()
 {
+    PROFILE_FUNCTION();
     REXDEBUG("Creating framebuffers...");
 
-    vkstate.framebuffers = malloc(sizeof(VkFramebuffer) * vkstate.image_count);
+    vkstate.framebuffers = rexallocate(sizeof(VkFramebuffer) * vkstate.image_count, MEMORY_TAG_RENDERER);
 
     for (u32 i = 0; i < vkstate.image_count; i++)
     {
-        VkImageView attachments[] = {vkstate.swapchain_image_views[i]};
+        // Same order as the render pass attachments.
+        VkImageView attachments[3] = {vkstate.swapchain_image_views[i], vkstate.depth_view};
+        u32 attachment_count = 2;
+        if (vkstate.msaa_samples > VK_SAMPLE_COUNT_1_BIT)
+        {
+            attachments[0] = vkstate.msaa_view;
+            attachments[2] = vkstate.swapchain_image_views[i];
+            attachment_count = 3;
+        }
 
         VkFramebufferCreateInfo framebuffer_info = {VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
         framebuffer_info.renderPass = vkstate.render_pass;
-        framebuffer_info.attachmentCount = 1;
+        framebuffer_info.attachmentCount = attachment_count;
         framebuffer_info.pAttachments = attachments;
         framebuffer_info.width = vkstate.framebuffer_width;
         framebuffer_info.height = vkstate.framebuffer_height;
         framebuffer_info.layers = 1;
 
-        if (vkCreateFramebuffer(vkstate.device, &framebuffer_info, 0, &vkstate.framebuffers[i]) != VK_SUCCESS)
+        if (vkCreateFramebuffer(vkstate.device, &framebuffer_info, vkstate.allocator, &vkstate.framebuffers[i]) != VK_SUCCESS)
         {
             REXFATAL("failed to create framebuffer[%i]!", i);
             return false;
@@ -801,13 +2080,14 @@ b8 create_framebuffers()
 
 b8 create_command_pool()
 {
+    PROFILE_FUNCTION();
     REXDEBUG("Creating commando pool...");
 
     VkCommandPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
     pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     pool_info.queueFamilyIndex = vkstate.graphics_queue_index.family_index;
 
-    if (vkCreateCommandPool(vkstate.device, &pool_info, 0, &vkstate.commando_pool) != VK_SUCCESS)
+    if (vkCreateCommandPool(vkstate.device, &pool_info, vkstate.allocator, &vkstate.commando_pool) != VK_SUCCESS)
     {
         REXFATAL("failed to create commando pool!");
         return false;
@@ -818,6 +2098,7 @@ b8 create_command_pool()
 
 b8 allocate_command_buffers()
 {
+    PROFILE_FUNCTION();
     REXDEBUG("Allocating command buffers..");
 
     VkCommandBufferAllocateInfo command_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
@@ -831,33 +2112,50 @@ b8 allocate_command_buffers()
         return false;
     }
 
+    for (u32 i = 0; vkstate.software_present && i < SOFTWARE_FRAME_COUNT; i++)
+    {
+        if (vkAllocateCommandBuffers(vkstate.device, &command_info, &vkstate.software_frames[i].command_buffer) != VK_SUCCESS)
+        {
+            REXFATAL("failed to allocate command buffers!");
+            return false;
+        }
+    }
+
     return true;
 }
 
-b8 record_command_buffer()
+b8 record_command_buffer(VkCommandBuffer command_buffer, u32 image_index, u32 frame_slot)
 {
+    PROFILE_FUNCTION();
     VkCommandBufferBeginInfo command_begin_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
 
-    if (vkBeginCommandBuffer(vkstate.command_buffer, &command_begin_info) != VK_SUCCESS)
+    if (vkBeginCommandBuffer(command_buffer, &command_begin_info) != VK_SUCCESS)
     {
         REXFATAL("failed to start command buffer!");
         return false;
     }
 
+    if (vkstate.timestamp_pool)
+    {
+        vkCmdResetQueryPool(command_buffer, vkstate.timestamp_pool, frame_slot * GPU_TIMESTAMP_COUNT, GPU_TIMESTAMP_COUNT);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, vkstate.timestamp_pool,
+                            frame_slot * GPU_TIMESTAMP_COUNT + GPU_TIMESTAMP_FRAME_BEGIN);
+    }
+
     VkRenderPassBeginInfo renderpass_info = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
     renderpass_info.renderPass = vkstate.render_pass;
-    renderpass_info.framebuffer = vkstate.framebuffers[vkstate.image_index];
+    renderpass_info.framebuffer = vkstate.framebuffers[image_index];
     renderpass_info.renderArea.offset = (VkOffset2D){0, 0};
     renderpass_info.renderArea.extent.width = vkstate.framebuffer_width;
     renderpass_info.renderArea.extent.height = vkstate.framebuffer_height;
 
-    VkClearValue clear_color = {{{0.0f, 0.0f, 0.1f, 1.0f}}};
-    renderpass_info.clearValueCount = 1;
-    renderpass_info.pClearValues = &clear_color;
-
-    vkCmdBeginRenderPass(vkstate.command_buffer, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
+    VkClearValue clear_values[2] = {0};
+    clear_values[0].color = (VkClearColorValue){{0.0f, 0.0f, 0.1f, 1.0f}};
+    clear_values[1].depthStencil = (VkClearDepthStencilValue){1.0f, 0};
+    renderpass_info.clearValueCount = 2;
+    renderpass_info.pClearValues = clear_values;
 
-    vkCmdBindPipeline(vkstate.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkstate.graphics_pipeline);
+    vkCmdBeginRenderPass(command_buffer, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
 
     VkViewport viewport = {0};
     viewport.x = 0.0f;
@@ -866,18 +2164,92 @@ b8 record_command_buffer()
     viewport.height = (f32)vkstate.framebuffer_height;
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(vkstate.command_buffer, 0, 1, &viewport);
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
 
     VkRect2D scissor = {0};
     scissor.offset = (VkOffset2D){0, 0};
     scissor.extent = (VkExtent2D){vkstate.framebuffer_width, vkstate.framebuffer_height};
-    vkCmdSetScissor(vkstate.command_buffer, 0, 1, &scissor);
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    // Grouped by pipeline, then front to back so early depth testing skips hidden fragments.
+    draw_list_begin(vkstate.scene_draw_count);
+    const PipelineDesc *hashed_desc = 0;
+    u32 pipeline_id = 0;
+    for (u32 i = 0; i < vkstate.scene_draw_count; i++)
+    {
+        const SceneDraw *draw = &vkstate.scene_draws[i];
+        if (draw->pipeline != hashed_desc)
+        {
+            // Draws of the same pipeline come in runs, only hashed when it changes. A collision
+            // of the top bits only costs a redundant bind.
+            hashed_desc = draw->pipeline;
+            pipeline_id = (u32)(pipeline_desc_hash(hashed_desc) >> 32);
+        }
+        draw_list_push(draw_key(pipeline_id, draw->constants.depth), i);
+    }
+    draw_list_sort();
 
-    vkCmdDraw(vkstate.command_buffer, 3, 1, 0, 0);
+    u32 draw_count;
+    const DrawItem *draws = draw_list_items(&draw_count);
+    const PipelineDesc *bound_desc = 0;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    for (u32 i = 0; i < draw_count; i++)
+    {
+        const SceneDraw *draw = &vkstate.scene_draws[draws[i].draw];
+        if (draw->pipeline != bound_desc)
+        {
+            bound_desc = draw->pipeline;
+            pipeline = get_pipeline_variant(bound_desc);
+            if (pipeline != VK_NULL_HANDLE)
+            {
+                vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                if (vkstate.extended_dynamic_state)
+                    set_dynamic_pipeline_state(command_buffer, bound_desc);
+            }
+        }
+        if (pipeline == VK_NULL_HANDLE)
+            continue;
 
-    vkCmdEndRenderPass(vkstate.command_buffer);
+        vkCmdPushConstants(command_buffer, vkstate.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants), &draw->constants);
+        vkCmdDraw(command_buffer, 3, 1, 0, 0);
+    }
 
-    if (vkEndCommandBuffer(vkstate.command_buffer) != VK_SUCCESS)
+    vkCmdEndRenderPass(command_buffer);
+
+    if (vkstate.timestamp_pool)
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vkstate.timestamp_pool,
+                            frame_slot * GPU_TIMESTAMP_COUNT + GPU_TIMESTAMP_RENDER_PASS_END);
+
+    if (vkstate.software_present)
+    {
+        SoftwareFrame *frame = &vkstate.software_frames[image_index];
+
+        VkBufferImageCopy region = {0};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = (VkExtent3D){vkstate.framebuffer_width, vkstate.framebuffer_height, 1};
+        vkCmdCopyImageToBuffer(command_buffer, vkstate.swapchain_images[image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               frame->readback_buffer, 1, &region);
+
+        VkBufferMemoryBarrier barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = frame->readback_buffer;
+        barrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                             0, 0, 1, &barrier, 0, 0);
+    }
+
+    if (vkstate.timestamp_pool)
+    {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vkstate.timestamp_pool,
+                            frame_slot * GPU_TIMESTAMP_COUNT + GPU_TIMESTAMP_FRAME_END);
+        vkstate.timestamps_written[frame_slot] = true;
+    }
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
     {
         REXFATAL("failed to finish command buffer!");
         return false;
@@ -888,75 +2260,403 @@ b8 record_command_buffer()
 
 b8 create_sync_objects()
 {
+    PROFILE_FUNCTION();
     VkSemaphoreCreateInfo semaphore_info = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
 
     VkFenceCreateInfo fence_info = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
     fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    if (vkCreateSemaphore(vkstate.device, &semaphore_info, 0, &vkstate.image_available_semaphore) != VK_SUCCESS ||
-        vkCreateSemaphore(vkstate.device, &semaphore_info, 0, &vkstate.render_finished_semaphore) != VK_SUCCESS ||
-        vkCreateFence(vkstate.device, &fence_info, 0, &vkstate.in_flight_fence) != VK_SUCCESS)
+    if (vkCreateSemaphore(vkstate.device, &semaphore_info, vkstate.allocator, &vkstate.image_available_semaphore) != VK_SUCCESS ||
+        vkCreateFence(vkstate.device, &fence_info, vkstate.allocator, &vkstate.in_flight_fence) != VK_SUCCESS)
     {
 
         REXFATAL("failed to create sync objects!");
         return false;
     }
 
+    for (u32 i = 0; vkstate.software_present && i < SOFTWARE_FRAME_COUNT; i++)
+    {
+        if (vkCreateFence(vkstate.device, &fence_info, vkstate.allocator, &vkstate.software_frames[i].fence) != VK_SUCCESS)
+        {
+            REXFATAL("failed to create sync objects!");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+b8 create_timestamp_pool()
+{
+    PROFILE_FUNCTION();
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vkstate.physical_device, &properties);
+
+    u32 queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(vkstate.physical_device, &queue_family_count, 0);
+    VkQueueFamilyProperties *queue_families = ARENA_PUSH(arena_scratch(), VkQueueFamilyProperties, queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(vkstate.physical_device, &queue_family_count, queue_families);
+    u32 valid_bits = queue_families[vkstate.graphics_queue_index.family_index].timestampValidBits;
+
+    // Only dynamic resolution needs GPU times, it stays off without them.
+    if (!valid_bits || !properties.limits.timestampPeriod)
+    {
+        REXINFO("Graphics queue has no timestamps, GPU times unavailable");
+        return true;
+    }
+    vkstate.timestamp_period = properties.limits.timestampPeriod;
+    vkstate.timestamp_mask = valid_bits < 64 ? (1ull << valid_bits) - 1 : ~0ull;
+
+    VkQueryPoolCreateInfo pool_info = {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = SOFTWARE_FRAME_COUNT * GPU_TIMESTAMP_COUNT;
+
+    if (vkCreateQueryPool(vkstate.device, &pool_info, vkstate.allocator, &vkstate.timestamp_pool) != VK_SUCCESS)
+    {
+        REXFATAL("failed to create timestamp query pool!");
+        return false;
+    }
+
     return true;
 }
 
+// Pairs a GPU timestamp with the CPU clock, later timestamps are converted relative to it.
+void calibrate_gpu_clock()
+{
+    VkCalibratedTimestampInfoEXT timestamp_infos[2] = {
+        {VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, 0, VK_TIME_DOMAIN_DEVICE_EXT},
+        {VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, 0, HOST_TIME_DOMAIN},
+    };
+    uint64_t timestamps[2];
+    uint64_t max_deviation;
+    if (vkstate.get_calibrated_timestamps(vkstate.device, 2, timestamp_infos, timestamps, &max_deviation) != VK_SUCCESS)
+        return;
+
+    vkstate.calibration_gpu_timestamp = timestamps[0];
+    vkstate.calibration_cpu_time = platform_clock_to_seconds(timestamps[1]);
+}
+
+// When a GPU timestamp was taken, in platform_get_absolute_time seconds.
+f64 gpu_timestamp_to_cpu_time(u64 timestamp)
+{
+    // Either side of the calibration, the difference wraps around like the timestamps do.
+    u64 ticks = (timestamp - vkstate.calibration_gpu_timestamp) & vkstate.timestamp_mask;
+    f64 signed_ticks = ticks > vkstate.timestamp_mask / 2 ? -(f64)((vkstate.timestamp_mask - ticks) + 1) : (f64)ticks;
+    return vkstate.calibration_cpu_time + signed_ticks * vkstate.timestamp_period * 1e-9;
+}
+
+// Adds the frame's GPU work to the trace's GPU track.
+void trace_gpu_frame(const u64 *timestamps)
+{
+    if (platform_get_absolute_time() - vkstate.calibration_cpu_time > GPU_CALIBRATION_INTERVAL)
+        calibrate_gpu_clock();
+
+    f64 begin = gpu_timestamp_to_cpu_time(timestamps[GPU_TIMESTAMP_FRAME_BEGIN]);
+    f64 render_pass_end = gpu_timestamp_to_cpu_time(timestamps[GPU_TIMESTAMP_RENDER_PASS_END]);
+    f64 end = gpu_timestamp_to_cpu_time(timestamps[GPU_TIMESTAMP_FRAME_END]);
+    profiler_gpu_zone("frame", begin, end);
+    profiler_gpu_zone("render pass", begin, render_pass_end);
+    if (vkstate.software_present)
+        profiler_gpu_zone("readback copy", render_pass_end, end);
+}
+
+// GPU time of the last frame recorded in a slot, in seconds, 0 if unknown. Only called once
+// the slot's fence signaled.
+f64 read_gpu_time(u32 frame_slot)
+{
+    if (!vkstate.timestamp_pool || !vkstate.timestamps_written[frame_slot])
+        return 0;
+
+    u64 timestamps[GPU_TIMESTAMP_COUNT];
+    if (vkGetQueryPoolResults(vkstate.device, vkstate.timestamp_pool, frame_slot * GPU_TIMESTAMP_COUNT, GPU_TIMESTAMP_COUNT,
+                              sizeof(timestamps), timestamps, sizeof(u64), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return 0;
+
+    if (vkstate.get_calibrated_timestamps && profiler_enabled())
+        trace_gpu_frame(timestamps);
+
+    u64 ticks = (timestamps[GPU_TIMESTAMP_FRAME_END] - timestamps[GPU_TIMESTAMP_FRAME_BEGIN]) & vkstate.timestamp_mask;
+    return (f64)ticks * vkstate.timestamp_period * 1e-9;
+}
+
+// Called once the slot's fence signaled, with the GPU time of the frame it last rendered.
+void update_render_resolution(u32 frame_slot)
+{
+    f64 gpu_time = read_gpu_time(frame_slot);
+    if (gpu_time > 0)
+        telemetry_record(TELEMETRY_GPU, gpu_time);
+
+    if (resolution_scaler_update(gpu_time))
+        vkstate.swapchain_dirty = true;
+}
+
+// Seconds since *time, which is moved to now.
+f64 lap(f64 *time)
+{
+    f64 now = platform_get_absolute_time();
+    f64 elapsed = now - *time;
+    *time = now;
+    return elapsed;
+}
+
+void destroy_swapchain_targets()
+{
+    for (u32 i = 0; i < vkstate.image_count; i++)
+    {
+        vkDestroyFramebuffer(vkstate.device, vkstate.framebuffers[i], vkstate.allocator);
+        vkDestroyImageView(vkstate.device, vkstate.swapchain_image_views[i], vkstate.allocator);
+    }
+    rexfree(vkstate.framebuffers);
+    rexfree(vkstate.swapchain_image_views);
+
+    vkDestroyImageView(vkstate.device, vkstate.msaa_view, vkstate.allocator);
+    vkDestroyImage(vkstate.device, vkstate.msaa_image, vkstate.allocator);
+    vkFreeMemory(vkstate.device, vkstate.msaa_memory, vkstate.allocator);
+    vkstate.msaa_view = VK_NULL_HANDLE;
+    vkstate.msaa_image = VK_NULL_HANDLE;
+    vkstate.msaa_memory = VK_NULL_HANDLE;
+
+    vkDestroyImageView(vkstate.device, vkstate.depth_view, vkstate.allocator);
+    vkDestroyImage(vkstate.device, vkstate.depth_image, vkstate.allocator);
+    vkFreeMemory(vkstate.device, vkstate.depth_memory, vkstate.allocator);
+    vkstate.depth_view = VK_NULL_HANDLE;
+    vkstate.depth_image = VK_NULL_HANDLE;
+    vkstate.depth_memory = VK_NULL_HANDLE;
+
+    if (vkstate.software_present)
+    {
+        for (u32 i = 0; i < vkstate.image_count; i++)
+        {
+            SoftwareFrame *frame = &vkstate.software_frames[i];
+            vkDestroyImage(vkstate.device, vkstate.swapchain_images[i], vkstate.allocator);
+            vkFreeMemory(vkstate.device, frame->image_memory, vkstate.allocator);
+            vkDestroyBuffer(vkstate.device, frame->readback_buffer, vkstate.allocator);
+            vkFreeMemory(vkstate.device, frame->readback_memory, vkstate.allocator);
+            frame->readback_pending = false;
+        }
+        if (!vkstate.headless)
+            platform_destroy_software_buffers(&window);
+    }
+    else if (vkstate.render_finished_semaphores)
+    {
+        for (u32 i = 0; i < vkstate.image_count; i++)
+            vkDestroySemaphore(vkstate.device, vkstate.render_finished_semaphores[i], vkstate.allocator);
+        rexfree(vkstate.render_finished_semaphores);
+        vkstate.render_finished_semaphores = 0;
+    }
+    rexfree(vkstate.swapchain_images);
+
+    vkstate.framebuffers = 0;
+    vkstate.swapchain_image_views = 0;
+    vkstate.swapchain_images = 0;
+    vkstate.image_count = 0;
+}
+
+// Window size scaled by the resolution scaler, when the platform can scale frames up.
+void get_render_size(u32 *out_width, u32 *out_height)
+{
+    f32 scale = !vkstate.headless && platform_supports_render_scaling(&window) ? resolution_scaler_get_scale() : 1.0f;
+    *out_width = (u32)(vkstate.window_width * scale + 0.5f);
+    *out_height = (u32)(vkstate.window_height * scale + 0.5f);
+    if (!*out_width)
+        *out_width = 1;
+    if (!*out_height)
+        *out_height = 1;
+}
+
+b8 recreate_swapchain()
+{
+    PROFILE_FUNCTION();
+    vkstate.swapchain_dirty = false;
+
+    u32 width, height;
+    get_render_size(&width, &height);
+
+    REXDEBUG("Resizing swapchain to %ix%i for a %ix%i window", width, height, vkstate.window_width, vkstate.window_height);
+    vkDeviceWaitIdle(vkstate.device);
+
+    destroy_swapchain_targets();
+    memset(vkstate.timestamps_written, 0, sizeof(vkstate.timestamps_written));
+    vkstate.framebuffer_width = width;
+    vkstate.framebuffer_height = height;
+
+    return create_swapchain() && create_render_targets() && create_framebuffers();
+}
+
 b8 init_vulkan()
 {
+    PROFILE_FUNCTION();
     REXDEBUG("Starting vulkan renderer...");
 
-    if (!create_instance())
-        return false;
-    if (!setup_debug_messenger())
-        return false;
-    if (!create_surface())
-        return false;
-    if (!pick_physical_device())
-        return false;
-    if (!create_logical_device())
-        return false;
-    if (!create_swapchain())
-        return false;
-    if (!create_render_pass())
-        return false;
-    if (!create_graphics_pipeline())
-        return false;
-    if (!create_framebuffers())
-        return false;
-    if (!create_command_pool())
-        return false;
-    if (!allocate_command_buffers())
-        return false;
-    if (!create_sync_objects())
+    vulkan_allocator_initialize();
+    vkstate.allocator = vulkan_allocator_callbacks();
+
+    // The create functions allocate their temporaries from the scratch arena, all freed here
+    // whether or not they succeeded.
+    ArenaTemp scratch = arena_temp_begin(arena_scratch());
+    b8 result = create_instance() &&
+                setup_debug_messenger() &&
+                create_surface() &&
+                pick_physical_device() &&
+                create_logical_device() &&
+                create_swapchain() &&
+                create_render_pass() &&
+                create_graphics_pipeline() &&
+                create_render_targets() &&
+                create_framebuffers() &&
+                create_command_pool() &&
+                allocate_command_buffers() &&
+                create_sync_objects() &&
+                create_timestamp_pool();
+    arena_temp_end(scratch);
+    if (!result)
         return false;
 
     REXINFO("Vulkan renderer started successfully");
     return true;
 }
 
+// Shows the newest frame whose readback finished, without waiting for the GPU. Older finished
+// frames are dropped, one still in flight is shown by a later call.
+void present_software_frame()
+{
+    PROFILE_FUNCTION();
+    SoftwareFrame *newest = 0;
+    for (u32 i = 0; i < SOFTWARE_FRAME_COUNT; i++)
+    {
+        SoftwareFrame *frame = &vkstate.software_frames[i];
+        if (!frame->readback_pending || vkGetFenceStatus(vkstate.device, frame->fence) != VK_SUCCESS)
+            continue;
+        if (!newest || frame->frame_number > newest->frame_number)
+            newest = frame;
+    }
+    if (!newest)
+        return;
+
+    if (!vkstate.headless)
+    {
+        platform_frame_presenting(&window);
+        // With every buffer still held by the compositor the frame stays pending and is retried.
+        if (!platform_present_software_frame(&window, newest->readback_data, vkstate.framebuffer_width * 4))
+            return;
+    }
+
+    for (u32 i = 0; i < SOFTWARE_FRAME_COUNT; i++)
+    {
+        if (vkstate.software_frames[i].frame_number <= newest->frame_number)
+            vkstate.software_frames[i].readback_pending = false;
+    }
+}
+
+void draw_frame_software()
+{
+    SoftwareFrame *frame = &vkstate.software_frames[vkstate.frame_index];
+
+    // Only blocks when the GPU is a whole ring of frames behind.
+    PROFILE_SCOPE(phase, "fence wait");
+    f64 time = platform_get_absolute_time();
+    vkWaitForFences(vkstate.device, 1, &frame->fence, VK_TRUE, UINT64_MAX);
+    telemetry_record(TELEMETRY_FENCE_WAIT, lap(&time));
+    profile_zone_next(&phase, "retire");
+    update_render_resolution(vkstate.frame_index);
+
+    // Retired pipelines may still be used by the other frames in flight.
+    b8 idle = true;
+    for (u32 i = 0; i < SOFTWARE_FRAME_COUNT; i++)
+    {
+        if (vkGetFenceStatus(vkstate.device, vkstate.software_frames[i].fence) != VK_SUCCESS)
+            idle = false;
+    }
+    if (idle)
+        destroy_retired_pipelines();
+
+    // Presenting would show the frame that is about to be overwritten.
+    if (frame->readback_pending)
+        present_software_frame();
+    frame->readback_pending = false;
+
+    vkResetFences(vkstate.device, 1, &frame->fence);
+    vkResetCommandBuffer(frame->command_buffer, 0);
+
+    profile_zone_next(&phase, "record");
+    lap(&time);
+    if (!record_command_buffer(frame->command_buffer, vkstate.frame_index, vkstate.frame_index))
+        return;
+    telemetry_record(TELEMETRY_RECORD, lap(&time));
+
+    profile_zone_next(&phase, "submit");
+
+    VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &frame->command_buffer;
+
+    if (vkQueueSubmit(vkstate.graphics_queue, 1, &submit_info, frame->fence) != VK_SUCCESS)
+    {
+        REXFATAL("failed to send queue!");
+        return;
+    }
+
+    frame->readback_pending = true;
+    frame->frame_number = ++vkstate.software_frame_count;
+    vkstate.frame_index = (vkstate.frame_index + 1) % SOFTWARE_FRAME_COUNT;
+
+    profile_zone_next(&phase, "present");
+    present_software_frame();
+    telemetry_record(TELEMETRY_SUBMIT, lap(&time));
+}
+
 void draw_frame()
 {
-    vkWaitForFences(vkstate.device, 1, &vkstate.in_flight_fence, VK_TRUE, UINT64_MAX);
-    vkResetFences(vkstate.device, 1, &vkstate.in_flight_fence);
+    PROFILE_FUNCTION();
+    if (vkstate.swapchain_dirty && !recreate_swapchain())
+    {
+        REXFATAL("failed to recreate swapchain!");
+        running = false;
+        return;
+    }
 
-    vkDeviceWaitIdle(vkstate.device);
+    if (vkstate.software_present)
+    {
+        draw_frame_software();
+        return;
+    }
 
-    vkAcquireNextImageKHR(vkstate.device, vkstate.swapchain, UINT64_MAX,
-                          vkstate.image_available_semaphore, 0, &vkstate.image_index);
+    PROFILE_SCOPE(phase, "fence wait");
+    f64 time = platform_get_absolute_time();
+    vkWaitForFences(vkstate.device, 1, &vkstate.in_flight_fence, VK_TRUE, UINT64_MAX);
+    telemetry_record(TELEMETRY_FENCE_WAIT, lap(&time));
+    profile_zone_next(&phase, "retire");
+    update_render_resolution(0);
+
+    // The fence covers the only frame in flight, nothing can use a retired pipeline anymore.
+    destroy_retired_pipelines();
+
+    profile_zone_next(&phase, "acquire");
+    lap(&time);
+    VkResult result = vkAcquireNextImageKHR(vkstate.device, vkstate.swapchain, UINT64_MAX,
+                                            vkstate.image_available_semaphore, 0, &vkstate.image_index);
+    telemetry_record(TELEMETRY_ACQUIRE, lap(&time));
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        // Nothing was signaled, the fence stays signaled for the next try.
+        vkstate.swapchain_dirty = true;
+        return;
+    }
 
+    profile_zone_next(&phase, "record");
+    vkResetFences(vkstate.device, 1, &vkstate.in_flight_fence);
     vkResetCommandBuffer(vkstate.command_buffer, 0);
 
-    if (!record_command_buffer())
+    if (!record_command_buffer(vkstate.command_buffer, vkstate.image_index, 0))
         return;
+    telemetry_record(TELEMETRY_RECORD, lap(&time));
+
+    profile_zone_next(&phase, "submit");
 
     VkSubmitInfo submit_info = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
 
     VkSemaphore wait_semaphores[] = {vkstate.image_available_semaphore};
-    VkSemaphore signal_semaphores[] = {vkstate.render_finished_semaphore};
+    VkSemaphore signal_semaphores[] = {vkstate.render_finished_semaphores[vkstate.image_index]};
     VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
     submit_info.waitSemaphoreCount = 1;
@@ -980,49 +2680,203 @@ void draw_frame()
     present_info.pSwapchains = &vkstate.swapchain;
     present_info.pImageIndices = &vkstate.image_index;
 
-    vkQueuePresentKHR(vkstate.present_queue, &present_info);
+    profile_zone_next(&phase, "present");
+    platform_frame_presenting(&window);
+    result = vkQueuePresentKHR(vkstate.present_queue, &present_info);
+    telemetry_record(TELEMETRY_SUBMIT, lap(&time));
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+    {
+        vkstate.swapchain_dirty = true;
+    }
 }
 
 void loop()
 {
-    platform_process_window_messages(&window);
+    // Start to start, so the frame time includes the pacing wait like the user sees it.
+    static f64 last_frame_start = 0;
+    f64 frame_start = platform_get_absolute_time();
+    if (last_frame_start > 0)
+        telemetry_record(TELEMETRY_CPU_FRAME, frame_start - last_frame_start);
+    last_frame_start = frame_start;
+    bench_begin_frame();
+
+    PROFILE_ZONE("frame");
+    arena_begin_frame();
+    // Benchmarks run as fast as the present mode lets them.
+    PROFILE_SCOPE(phase, "wait for frame");
+    if (!vkstate.headless && !bench_active())
+        platform_wait_for_frame(&window);
+    profile_zone_next(&phase, "input");
+    if (!vkstate.headless)
+        platform_process_window_messages(&window);
+    input_update();
+    event_dispatch_queued();
+
+    profile_zone_next(&phase, "pipelines");
+    char shader_name[SHADER_RELOAD_MAX_NAME];
+    while (shader_reload_poll(shader_name))
+        reload_shader(shader_name);
+
+    update_pipeline_variants();
+    profile_zone_end(&phase);
+
     draw_frame();
+    telemetry_end_frame();
+    if (!bench_end_frame())
+        running = false;
 }
 
 void cleanup()
 {
-    vkDeviceWaitIdle(vkstate.device);
+    shader_reload_shutdown();
 
-    vkDestroySemaphore(vkstate.device, vkstate.image_available_semaphore, 0);
-    vkDestroySemaphore(vkstate.device, vkstate.render_finished_semaphore, 0);
-    vkDestroyFence(vkstate.device, vkstate.in_flight_fence, 0);
+    // Let queued compiles finish so every created pipeline is collected and destroyed. Jobs
+    // queued from here on run right away on this thread.
+    jobs_shutdown();
+    vkstate.optimize_linked_pipelines = false;
+    wait_for_pipeline_compiles();
 
-    vkDestroyCommandPool(vkstate.device, vkstate.commando_pool, 0);
+    vkDeviceWaitIdle(vkstate.device);
 
-    for (u32 i = 0; i < vkstate.image_count; i++)
-        vkDestroyFramebuffer(vkstate.device, vkstate.framebuffers[i], 0);
-    free(vkstate.framebuffers);
+    vkDestroySemaphore(vkstate.device, vkstate.image_available_semaphore, vkstate.allocator);
+    vkDestroyFence(vkstate.device, vkstate.in_flight_fence, vkstate.allocator);
+    for (u32 i = 0; vkstate.software_present && i < SOFTWARE_FRAME_COUNT; i++)
+        vkDestroyFence(vkstate.device, vkstate.software_frames[i].fence, vkstate.allocator);
 
-    vkDestroyPipeline(vkstate.device, vkstate.graphics_pipeline, 0);
-    vkDestroyPipelineLayout(vkstate.device, vkstate.pipeline_layout, 0);
-    vkDestroyRenderPass(vkstate.device, vkstate.render_pass, 0);
+    vkDestroyQueryPool(vkstate.device, vkstate.timestamp_pool, vkstate.allocator);
+    vkDestroyCommandPool(vkstate.device, vkstate.commando_pool, vkstate.allocator);
 
-    for (u32 i = 0; i < vkstate.image_count; i++)
-        vkDestroyImageView(vkstate.device, vkstate.swapchain_image_views[i], 0);
-    free(vkstate.swapchain_image_views);
+    destroy_swapchain_targets();
 
-    vkDestroySwapchainKHR(vkstate.device, vkstate.swapchain, 0);
-    vkDestroyDevice(vkstate.device, 0);
+    destroy_retired_pipelines();
+    rexarray_destroy(vkstate.retired_pipelines);
+    destroy_pipeline_variants();
+    vkDestroyPipelineCache(vkstate.device, vkstate.pipeline_cache, vkstate.allocator);
+    vkDestroyPipelineLayout(vkstate.device, vkstate.pipeline_layout, vkstate.allocator);
+    vkDestroyRenderPass(vkstate.device, vkstate.render_pass, vkstate.allocator);
+
+    vkDestroySwapchainKHR(vkstate.device, vkstate.swapchain, vkstate.allocator);
+    vkDestroyDevice(vkstate.device, vkstate.allocator);
+    rexarray_destroy(vkstate.queue_count);
+    rexarray_destroy(vkstate.queue_family_indexes);
     destroy_swapchain_support(&vkstate.swapchain_support);
-    vkDestroySurfaceKHR(vkstate.instance, vkstate.surface, 0);
+    vkDestroySurfaceKHR(vkstate.instance, vkstate.surface, vkstate.allocator);
+
+    if (VULKAN_VALIDATION)
+    {
+        PFN_vkDestroyDebugUtilsMessengerEXT func =
+            (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(vkstate.instance, "vkDestroyDebugUtilsMessengerEXT");
+        func(vkstate.instance, vkstate.debug_messenger, vkstate.allocator);
+    }
+
+    vkDestroyInstance(vkstate.instance, vkstate.allocator);
+    vulkan_allocator_log_stats();
+    vulkan_allocator_shutdown();
+
+    rexfree(vkstate.scene_draws);
+    arena_shutdown();
+    resolution_scaler_shutdown();
+    telemetry_shutdown();
+    profiler_shutdown();
+    if (!vkstate.headless)
+        platform_destroy_window(&window);
+    input_shutdown();
+    event_shutdown();
+
+    // Everything is freed by now, what's left leaked.
+    memory_log_usage();
+    memory_report_leaks();
+}
+
+// Compares the newest rendered frame against a golden image, or replaces the image with it.
+// Frames that don't match, or have no golden image yet, are written next to it as
+// <path>.actual.ppm. A missing golden image is not a mismatch, it sets out_missing instead.
+b8 check_golden_image(const char *path, b8 update, u32 max_delta, f64 min_psnr, b8 *out_missing)
+{
+    *out_missing = false;
+    vkDeviceWaitIdle(vkstate.device);
 
-    PFN_vkDestroyDebugUtilsMessengerEXT func =
-        (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(vkstate.instance, "vkDestroyDebugUtilsMessengerEXT");
-    func(vkstate.instance, vkstate.debug_messenger, 0);
+    SoftwareFrame *newest = 0;
+    for (u32 i = 0; i < SOFTWARE_FRAME_COUNT; i++)
+    {
+        SoftwareFrame *frame = &vkstate.software_frames[i];
+        if (frame->frame_number && (!newest || frame->frame_number > newest->frame_number))
+            newest = frame;
+    }
+    if (!newest)
+    {
+        REXERROR("no frame was rendered to compare against %s!", path);
+        return false;
+    }
+
+    u32 width = vkstate.framebuffer_width;
+    u32 height = vkstate.framebuffer_height;
+    if (update)
+    {
+        if (!golden_image_write(path, newest->readback_data, width, height, width * 4))
+        {
+            REXERROR("failed to write golden image [%s]!", path);
+            return false;
+        }
+        REXINFO("Golden image %s updated", path);
+        return true;
+    }
+
+    GoldenComparison comparison;
+    b8 passed = false;
+    if (!golden_image_exists(path))
+    {
+        REXWARN("No golden image %s, create it with --update-golden", path);
+        *out_missing = true;
+    }
+    else if (!golden_image_compare(path, newest->readback_data, width, height, width * 4, &comparison))
+    {
+        REXERROR("failed to read golden image [%s]!", path);
+    }
+    else if (!comparison.size_matches)
+    {
+        REXERROR("%s is not %ix%i", path, width, height);
+    }
+    else if (comparison.max_delta <= max_delta && comparison.psnr >= min_psnr)
+    {
+        REXINFO("%s matches, max delta %i, PSNR %.1f dB", path, comparison.max_delta, comparison.psnr);
+        passed = true;
+    }
+    else
+    {
+        REXERROR("%s differs in %llu pixels, max delta %i (%i allowed), PSNR %.1f dB (%.1f needed)", path,
+                 comparison.differing_pixels, comparison.max_delta, max_delta, comparison.psnr, min_psnr);
+    }
 
-    vkDestroyInstance(vkstate.instance, 0);
+    if (!passed)
+    {
+        char actual_path[512];
+        snprintf(actual_path, sizeof(actual_path), "%s.actual.ppm", path);
+        if (golden_image_write(actual_path, newest->readback_data, width, height, width * 4))
+        {
+            REXINFO("Rendered frame written to %s", actual_path);
+        }
+    }
+    return passed;
+}
 
-    platform_destroy_window(&window);
+// Triangles stacked behind each other, each one a bit larger than the one in front of it.
+// They're added back to front, the worst order for overdraw, and left to the draw sorting.
+// With shader variants every layer takes the next style.
+void create_scene(u32 layers)
+{
+    vkstate.scene_draw_count = layers;
+    vkstate.scene_draws = rexallocate(sizeof(SceneDraw) * layers, MEMORY_TAG_RENDERER);
+    for (u32 i = 0; i < layers; i++)
+    {
+        u32 layer = layers - 1 - i;
+        SceneDraw *draw = &vkstate.scene_draws[i];
+        draw->pipeline = vkstate.shader_variants ? &vkstate.scene_styles[layer % SCENE_STYLE_COUNT] : &vkstate.pipeline_desc;
+        draw->constants.offset[0] = 0.0f;
+        draw->constants.offset[1] = 0.0f;
+        draw->constants.scale = 1.0f + 0.5f * layer / layers;
+        draw->constants.depth = (f32)layer / layers;
+    }
 }
 
 b8 close_event(u16 code, void *sender, EventContext data)
@@ -1031,19 +2885,148 @@ b8 close_event(u16 code, void *sender, EventContext data)
     return false;
 }
 
-int main()
+b8 resize_event(u16 code, void *sender, EventContext data)
 {
+    vkstate.window_width = data.data.u16[0];
+    vkstate.window_height = data.data.u16[1];
+    vkstate.swapchain_dirty = true;
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    b8 watch_shaders = false;
+    f64 target_gpu_time = 0;
+    vkstate.extended_dynamic_state = true;
+    vkstate.msaa_samples = VK_SAMPLE_COUNT_1_BIT;
+    vkstate.preferred_present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+    u32 overdraw = 1;
+    const char *telemetry_path = 0;
+    const char *trace_path = 0;
+    BenchConfig bench = {0};
+    bench.warmup_frames = BENCH_DEFAULT_WARMUP_FRAMES;
+    bench.results_path = "bench.json";
+    bench.regression_threshold = BENCH_DEFAULT_THRESHOLD / 100.0;
+    const char *golden_path = 0;
+    b8 update_golden = false;
+    u32 golden_max_delta = GOLDEN_DEFAULT_MAX_DELTA;
+    f64 golden_min_psnr = GOLDEN_DEFAULT_MIN_PSNR;
+    for (i32 i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--watch-shaders"))
+            watch_shaders = true;
+        else if (!strcmp(argv[i], "--static-pipeline-state"))
+            vkstate.extended_dynamic_state = false;
+        else if (!strcmp(argv[i], "--shm-present"))
+            vkstate.software_present = true;
+        else if (!strcmp(argv[i], "--dynamic-resolution") && i + 1 < argc)
+            target_gpu_time = atof(argv[++i]) / 1000.0;
+        else if (!strcmp(argv[i], "--msaa") && i + 1 < argc)
+        {
+            // Sample count bits are the sample count, lowered to a supported one later.
+            u32 samples = atoi(argv[++i]);
+            vkstate.msaa_samples = VK_SAMPLE_COUNT_1_BIT;
+            while (vkstate.msaa_samples * 2 <= samples && vkstate.msaa_samples < VK_SAMPLE_COUNT_64_BIT)
+                vkstate.msaa_samples *= 2;
+        }
+        else if (!strcmp(argv[i], "--overdraw") && i + 1 < argc)
+            overdraw = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--shader-variants"))
+            vkstate.shader_variants = true;
+        else if (!strcmp(argv[i], "--telemetry") && i + 1 < argc)
+            telemetry_path = argv[++i];
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+            trace_path = argv[++i];
+        else if (!strcmp(argv[i], "--headless"))
+        {
+            vkstate.headless = true;
+            vkstate.software_present = true;
+        }
+        else if (!strcmp(argv[i], "--present-mode") && i + 1 < argc)
+        {
+            const char *mode = argv[++i];
+            if (!strcmp(mode, "immediate"))
+                vkstate.preferred_present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            else if (!strcmp(mode, "fifo"))
+                vkstate.preferred_present_mode = VK_PRESENT_MODE_FIFO_KHR;
+            else if (!strcmp(mode, "fifo_relaxed"))
+                vkstate.preferred_present_mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            else
+                vkstate.preferred_present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+        }
+        else if (!strcmp(argv[i], "--bench") && i + 1 < argc)
+            bench.frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--bench-warmup") && i + 1 < argc)
+            bench.warmup_frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--bench-results") && i + 1 < argc)
+            bench.results_path = argv[++i];
+        else if (!strcmp(argv[i], "--bench-baseline") && i + 1 < argc)
+            bench.baseline_path = argv[++i];
+        else if (!strcmp(argv[i], "--bench-threshold") && i + 1 < argc)
+            bench.regression_threshold = atof(argv[++i]) / 100.0;
+        else if (!strcmp(argv[i], "--golden") && i + 1 < argc)
+            golden_path = argv[++i];
+        else if (!strcmp(argv[i], "--update-golden"))
+            update_golden = true;
+        else if (!strcmp(argv[i], "--golden-max-delta") && i + 1 < argc)
+            golden_max_delta = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--golden-min-psnr") && i + 1 < argc)
+            golden_min_psnr = atof(argv[++i]);
+    }
+
+    // Golden image checks render a few headless frames, timed like a short benchmark.
+    if (golden_path)
+    {
+        vkstate.headless = true;
+        vkstate.software_present = true;
+        bench.frames = GOLDEN_FRAMES;
+        bench.warmup_frames = GOLDEN_WARMUP_FRAMES;
+        bench.results_path = 0;
+        bench.baseline_path = 0;
+        target_gpu_time = 0;
+    }
+
     logger_initialize();
+
+    // Written as CSV when the file is named like it, JSON lines otherwise. Started before the
+    // other systems, like the benchmark, so a run that can't record what it was asked to
+    // stops right away.
+    const char *extension = telemetry_path ? strrchr(telemetry_path, '.') : 0;
+    TelemetryFormat telemetry_format = extension && !strcmp(extension, ".csv") ? TELEMETRY_FORMAT_CSV : TELEMETRY_FORMAT_JSON;
+    if (!telemetry_initialize(telemetry_path, telemetry_format, TELEMETRY_EXPORT_INTERVAL))
+        return 1;
+    if (bench.frames && !bench_initialize(&bench))
+    {
+        telemetry_shutdown();
+        return 1;
+    }
+
+    // Before the job threads start, so they show up in the trace.
+    profiler_initialize(trace_path);
     event_initialize();
+    input_initialize();
+    jobs_initialize(0);
+    arena_initialize(ARENA_FRAME_SIZE, ARENA_SCRATCH_SIZE);
 
     event_register(EVENT_CODE_APPLICATION_QUIT, 0, close_event);
+    event_register(EVENT_CODE_RESIZED, 0, resize_event);
+    event_register(EVENT_CODE_PIPELINE_COMPILED, 0, pipeline_compiled_event);
 
-    platform_create_window("Triangle", 200, 200, 1280, 720, &window);
-
-    platform_show_window(&window);
+    if (vkstate.headless)
+    {
+        vkstate.window_width = WINDOW_WIDTH;
+        vkstate.window_height = WINDOW_HEIGHT;
+    }
+    else
+    {
+        platform_create_window("Triangle", 200, 200, WINDOW_WIDTH, WINDOW_HEIGHT, &window);
+        platform_show_window(&window);
+        platform_get_framebuffer_size(&window, &vkstate.window_width, &vkstate.window_height);
+    }
+    vkstate.framebuffer_width = vkstate.window_width;
+    vkstate.framebuffer_height = vkstate.window_height;
 
-    vkstate.framebuffer_width = 1280;
-    vkstate.framebuffer_height = 720;
+    create_scene(overdraw > 0 ? overdraw : 1);
 
     if (!init_vulkan())
     {
@@ -1051,10 +3034,54 @@ int main()
         running = false;
     }
 
+    if (running && target_gpu_time > 0)
+    {
+        if (vkstate.headless || !platform_supports_render_scaling(&window))
+        {
+            REXWARN("Frames can't be scaled to the window, dynamic resolution disabled");
+        }
+        else if (!vkstate.timestamp_pool)
+        {
+            REXWARN("No GPU timestamps, dynamic resolution disabled");
+        }
+        else
+        {
+            resolution_scaler_initialize(target_gpu_time, DYNAMIC_RESOLUTION_MIN_SCALE);
+        }
+    }
+
+    // The app runs from app/, next to the compiled shaders, with the sources one level up.
+    if (running && watch_shaders)
+        shader_reload_initialize("../shader", "shader");
+
+    // Draws are skipped while their pipeline compiles. A golden image needs all of them, and
+    // a benchmark would count frames that drew nothing.
+    if (running && (golden_path || bench.frames))
+        wait_for_pipeline_compiles();
+
     while (running)
         loop();
 
+    // A benchmark that failed to start, stopped early or regressed fails the run, so does a
+    // frame that doesn't match its golden image. One without a golden image has its own code.
+    b8 passed = true;
+    b8 golden_missing = false;
+    if (bench_active())
+    {
+        VkPhysicalDeviceProperties properties = {0};
+        if (vkstate.physical_device)
+            vkGetPhysicalDeviceProperties(vkstate.physical_device, &properties);
+        const char *present_mode = vkstate.headless          ? "headless"
+                                   : vkstate.software_present ? "software"
+                                                              : present_mode_name(vkstate.present_mode);
+        passed = bench_finish(properties.deviceName, present_mode);
+        if (passed && golden_path)
+            passed = check_golden_image(golden_path, update_golden, golden_max_delta, golden_min_psnr, &golden_missing);
+    }
+
     cleanup();
 
-    return 0;
+    if (golden_missing)
+        return GOLDEN_MISSING_EXIT_CODE;
+    return passed ? 0 : 1;
 }